@@ -0,0 +1,180 @@
+// Chinese Dark Chess: assignment heuristic
+// ----------------------------------
+// A lower bound on the moves left. Every red piece is captured by a piece
+// coming either from where it stands now, or from the square of that piece's
+// previous capture. Give each red piece such a predecessor, no predecessor
+// used twice, and the capture distances add up to at most the moves any
+// solution makes. The cheapest such assignment is therefore admissible.
+// Cycles among the red pieces are allowed, which only makes it lower.
+//
+// Solved with the Hungarian algorithm, on a matrix of fixed size. The matrix
+// is kept in the HeuristicCache: a move only changes the mover's column and
+// drops the captured piece, red pieces never move and black ones never change.
+
+#include "heuristic.h"
+
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+// Red pieces are the rows, black pieces then red pieces the columns
+constexpr int MAX_ROWS = SIDE_PIECE_NB;
+constexpr int MAX_COLS = 2 * MAX_ROWS;
+
+/*
+ * Cheapest assignment of every row to a different column.
+ * @param   cost    rows x cols matrix, rows <= cols
+ * @returns Its total cost
+ */
+int hungarian(const uint16_t cost[MAX_ROWS][MAX_COLS], int rows, int cols)
+{
+    // Potentials, and the row each column is matched with (0 for none, rows count from 1)
+    int u[MAX_ROWS + 1] = {}, v[MAX_COLS + 1] = {}, match[MAX_COLS + 1] = {}, way[MAX_COLS + 1] = {};
+    int slack[MAX_COLS + 1];
+    bool done[MAX_COLS + 1];
+    for (int i = 1; i <= rows; i += 1) {
+        // Grow an alternating tree from row i until it reaches a free column
+        match[0] = i;
+        int j0   = 0;
+        std::fill(slack, slack + cols + 1, INT_MAX);
+        std::fill(done, done + cols + 1, false);
+        do {
+            done[j0]  = true;
+            int i0    = match[j0];
+            int delta = INT_MAX;
+            int j1    = 0;
+            for (int j = 1; j <= cols; j += 1) {
+                if (done[j]) {
+                    continue;
+                }
+                int reduced = int(cost[i0 - 1][j - 1]) - u[i0] - v[j];
+                if (reduced < slack[j]) {
+                    slack[j] = reduced;
+                    way[j]   = j0;
+                }
+                if (slack[j] < delta) {
+                    delta = slack[j];
+                    j1    = j;
+                }
+            }
+            for (int j = 0; j <= cols; j += 1) {
+                if (done[j]) {
+                    u[match[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    slack[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (match[j0] != 0);
+        // Flip the path
+        do {
+            int j1    = way[j0];
+            match[j0] = match[j1];
+            j0        = j1;
+        } while (j0 != 0);
+    }
+
+    int total = 0;
+    for (int j = 1; j <= cols; j += 1) {
+        if (match[j]) {
+            total += cost[match[j] - 1][j - 1];
+        }
+    }
+    return total;
+}
+
+/*
+ * Column _b_ of the matrix, the legs of black piece _b_.
+ */
+void black_legs(HeuristicCache &cache, int b)
+{
+    for (int r = 0; r < cache.reds; r += 1) {
+        cache.leg[r][b] = cache.blackType[b] > cache.redType[r]
+                            ? capture_leg(cache.blackType[b], cache.black[b], cache.red[r])
+                            : NO_LEG;
+    }
+}
+
+} // namespace
+
+void assignment_legs(const Position &pos, HeuristicCache &cache)
+{
+    cache.reds   = 0;
+    cache.blacks = 0;
+    for (Square sq : BoardView(pos.pieces(Red) & ~pos.pieces(Duck))) {
+        cache.red[cache.reds]     = sq;
+        cache.redType[cache.reds] = pos.peek_piece_at(sq).type;
+        cache.reds += 1;
+    }
+    for (Square sq : BoardView(pos.pieces(Black) & ~pos.pieces(Duck))) {
+        cache.black[cache.blacks]     = sq;
+        cache.blackType[cache.blacks] = pos.peek_piece_at(sq).type;
+        cache.blacks += 1;
+    }
+
+    for (int b = 0; b < cache.blacks; b += 1) {
+        black_legs(cache, b);
+    }
+    // From another red piece's square, by a piece that can capture both
+    for (int r = 0; r < cache.reds; r += 1) {
+        for (int p = 0; p < cache.reds; p += 1) {
+            int best = NO_LEG;
+            for (int b = 0; p != r && b < cache.blacks; b += 1) {
+                if (cache.blackType[b] > cache.redType[r] && cache.blackType[b] > cache.redType[p]) {
+                    best = std::min(best, capture_leg(cache.blackType[b], cache.red[p], cache.red[r]));
+                }
+            }
+            cache.leg[r][cache.blacks + p] = uint16_t(best);
+        }
+    }
+}
+
+void assignment_legs_after(const Position &child, const HeuristicCache &parent, const Move &mv, HeuristicCache &cache)
+{
+    int mover = 0;
+    while (mover < parent.blacks && parent.black[mover] != mv.from()) {
+        mover += 1;
+    }
+    if (mover == parent.blacks) { // not a known piece moving, start over
+        assignment_legs(child, cache);
+        return;
+    }
+
+    int captured = 0;
+    while (captured < parent.reds && parent.red[captured] != mv.to()) {
+        captured += 1;
+    }
+    // Drop its row and its column
+    int cols     = parent.blacks + parent.reds;
+    cache.reds   = 0;
+    cache.blacks = parent.blacks;
+    for (int r = 0; r < parent.reds; r += 1) {
+        if (r == captured) {
+            continue;
+        }
+        cache.red[cache.reds]     = parent.red[r];
+        cache.redType[cache.reds] = parent.redType[r];
+        uint16_t *row             = cache.leg[cache.reds];
+        const uint16_t *from      = parent.leg[r];
+        int split                 = parent.blacks + captured;
+        std::copy(from, from + std::min(split, cols), row);
+        if (split < cols) {
+            std::copy(from + split + 1, from + cols, row + split);
+        }
+        cache.reds += 1;
+    }
+    std::copy(parent.black, parent.black + parent.blacks, cache.black);
+    std::copy(parent.blackType, parent.blackType + parent.blacks, cache.blackType);
+    cache.black[mover] = mv.to();
+    black_legs(cache, mover);
+}
+
+int assignment_heuristic(const HeuristicCache &cache)
+{
+    if (cache.reds == 0) {
+        return 0;
+    }
+    return std::min(hungarian(cache.leg, cache.reds, cache.blacks + cache.reds), NO_LEG);
+}
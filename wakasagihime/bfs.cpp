@@ -0,0 +1,271 @@
+// Chinese Dark Chess: exhaustive BFS
+// ----------------------------------
+// Breadth-first search over every state of the puzzle, for puzzles with few
+// black pieces. StateIndexer numbers the states with no gaps, so the visited
+// set and each layer are bitsets of one bit per state, and a layer is expanded
+// by scanning its bitset in order. No heuristic is involved, so the first goal
+// found is a shortest one.
+//
+// Every layer is kept, as a sorted list of numbers once it is expanded if
+// that is smaller than its bitset. The path is rebuilt backwards: from a state
+// at depth d, the states one move before it are worked out and looked up in
+// layer d - 1.
+
+#include "rank.h"
+#include "search.h"
+#include "state.h"
+
+#include <algorithm>
+#include <new>
+
+namespace {
+
+/*
+ * One bit per state. Allocation failures leave it empty instead of throwing.
+ */
+class Bitset {
+    private:
+    uint64_t *words;
+
+    public:
+    explicit Bitset(uint64_t bits)
+      : words(new (std::nothrow) uint64_t[(bits + 63) / 64]())
+    {}
+    ~Bitset() { delete[] words; }
+
+    Bitset(const Bitset &)            = delete;
+    Bitset &operator=(const Bitset &) = delete;
+
+    bool okay() const { return words != nullptr; }
+    bool test(uint64_t i) const { return (words[i >> 6] >> (i & 63)) & 1; }
+    void set(uint64_t i) { words[i >> 6] |= uint64_t(1) << (i & 63); }
+    uint64_t word(uint64_t w) const { return words[w]; }
+};
+
+/*
+ * The states at one depth: a bitset while it is filled and expanded,
+ * then maybe a sorted list.
+ */
+struct Layer {
+    Bitset *bits;
+    std::vector<uint64_t> list;
+
+    bool test(uint64_t i) const { return bits ? bits->test(i) : std::binary_search(list.begin(), list.end(), i); }
+};
+
+constexpr uint64_t NO_STATE = UINT64_MAX;
+
+class ExhaustiveSearch {
+    private:
+    Position &root;
+    const SearchLimits &limits;
+    StateCodec codec;
+    StateIndexer indexer;
+    std::vector<Layer> layers;
+    size_t held; // bytes of the bitsets and lists in layers
+    uint64_t nodes;
+
+    /*
+     * Looks for a state in layer _depth_ with a move to _target_.
+     * @param   target  Overwritten with that state's number
+     * @param   move    The move
+     */
+    bool predecessor(int depth, uint64_t &target, Move &move) const
+    {
+        State s = indexer.unrank(target);
+        Position pos;
+        codec.decode(s, pos);
+
+        uint32_t redAlive = uint32_t(s.lo & ((uint64_t(1) << codec.red_count()) - 1));
+        Square squares[MAX_SLOTS];
+        for (int i = 0; i < codec.black_count(); i += 1) {
+            squares[i] = codec.black_square(s, i);
+        }
+        Board empty = ~pos.pieces() & ~pos.pieces(Duck);
+
+        // Black piece i came to x from an empty square, maybe capturing there
+        for (int i = 0; i < codec.black_count(); i += 1) {
+            Square x = squares[i];
+            int lo = i, hi = i + 1;
+            while (lo > 0 && codec.black_type(lo - 1) == codec.black_type(i)) {
+                lo -= 1;
+            }
+            while (hi < codec.black_count() && codec.black_type(hi) == codec.black_type(i)) {
+                hi += 1;
+            }
+            int captured = -1;
+            for (int j = 0; j < codec.red_count(); j += 1) {
+                if (codec.red_square(j) == x && !StateCodec::red_alive(s, j)) {
+                    captured = j;
+                }
+            }
+
+            for (Square y : BoardView(empty)) {
+                Square before[MAX_SLOTS];
+                std::copy(squares, squares + codec.black_count(), before);
+                before[i] = y;
+                std::sort(before + lo, before + hi);
+                int revives[2] = { -1, captured };
+                for (int t = 0; t < (captured < 0 ? 1 : 2); t += 1) {
+                    int revive     = revives[t];
+                    uint32_t mask  = revive < 0 ? redAlive : redAlive | (uint32_t(1) << revive);
+                    State p        = codec.compose(mask, before);
+                    uint64_t index = indexer.rank(p);
+                    if (!layers[depth].test(index)) {
+                        continue;
+                    }
+                    Position prev;
+                    codec.decode(p, prev);
+                    Move mv(y, x);
+                    MoveList<> moves(prev);
+                    if (std::find(moves.begin(), moves.end(), mv) == moves.end()) {
+                        continue;
+                    }
+                    UndoInfo ui;
+                    prev.do_move_unchecked(mv, ui);
+                    if (codec.encode(prev) == s) {
+                        target = index;
+                        move   = mv;
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    bool add_layer(uint64_t states, size_t bytes)
+    {
+        Bitset *bits = new (std::nothrow) Bitset(states);
+        if (!bits || !bits->okay()) {
+            delete bits;
+            return false;
+        }
+        layers.push_back(Layer{ bits, {} });
+        held += bytes;
+        return true;
+    }
+
+    /*
+     * Swaps an expanded layer's bitset for a list of its states, if smaller.
+     */
+    void compact(Layer &layer, size_t bytes)
+    {
+        uint64_t size = 0;
+        for (uint64_t w = 0; w < bytes / 8; w += 1) {
+            size += __builtin_popcountll(layer.bits->word(w));
+        }
+        if (size * sizeof(uint64_t) >= bytes) {
+            return;
+        }
+        layer.list.reserve(size);
+        for (uint64_t w = 0; w < bytes / 8; w += 1) {
+            for (uint64_t bits = layer.bits->word(w); bits; bits &= bits - 1) {
+                layer.list.push_back(w * 64 + __builtin_ctzll(bits));
+            }
+        }
+        delete layer.bits;
+        layer.bits = nullptr;
+        held -= bytes - size * sizeof(uint64_t);
+    }
+
+    public:
+    ExhaustiveSearch(Position &root, const SearchLimits &limits)
+      : root(root)
+      , limits(limits)
+      , codec(root)
+      , indexer(codec, root)
+      , held(0)
+      , nodes(0)
+    {}
+    ~ExhaustiveSearch()
+    {
+        for (Layer &layer : layers) {
+            delete layer.bits;
+        }
+    }
+
+    ExhaustiveSearch(const ExhaustiveSearch &)            = delete;
+    ExhaustiveSearch &operator=(const ExhaustiveSearch &) = delete;
+
+    bool run(std::vector<Move> &path)
+    {
+        uint64_t states = indexer.size();
+        size_t budget   = memory_budget();
+        size_t bytes    = (states + 63) / 64 * 8;
+        DBG << "Exhaustive BFS: " << states << " states\n";
+        if (states == StateIndexer::TOO_MANY || states / 8 > budget / 3) {
+            return false;
+        }
+        Bitset visited(states);
+        if (!visited.okay() || !add_layer(states, bytes)) {
+            return false;
+        }
+        uint64_t start = indexer.rank(codec.encode(root));
+        visited.set(start);
+        layers.back().bits->set(start);
+
+        Position pos;
+        uint64_t goal = NO_STATE;
+        for (int depth = 0; goal == NO_STATE; depth += 1) {
+            // The visited set, the layers so far and the one being filled
+            if (bytes + held + bytes > budget || !add_layer(states, bytes)) {
+                DBG << "Exhaustive BFS: out of memory at depth " << depth << "\n";
+                return false;
+            }
+            Bitset &next = *layers.back().bits;
+
+            const Bitset &layer = *layers[depth].bits;
+            uint64_t size       = 0;
+            for (uint64_t w = 0; w < bytes / 8 && goal == NO_STATE; w += 1) {
+                for (uint64_t bits = layer.word(w); bits && goal == NO_STATE; bits &= bits - 1) {
+                    if ((++nodes & 1023) == 0 && limits.expired()) {
+                        return false;
+                    }
+                    codec.decode(indexer.unrank(w * 64 + __builtin_ctzll(bits)), pos);
+                    MoveList<> moves(pos);
+                    for (const Move &mv : moves) {
+                        UndoInfo ui;
+                        pos.do_move_unchecked(mv, ui);
+                        uint64_t index = indexer.rank(codec.encode(pos));
+                        if (!visited.test(index)) {
+                            visited.set(index);
+                            next.set(index);
+                            size += 1;
+                            if (pos.is_hw1_goal()) {
+                                goal = index;
+                            }
+                        }
+                        pos.undo_move(mv, ui);
+                        if (goal != NO_STATE) {
+                            break;
+                        }
+                    }
+                }
+            }
+            if (size == 0) {
+                return false; // every reachable state is visited, none is a goal
+            }
+            compact(layers[depth], bytes);
+        }
+
+        path.clear();
+        for (int depth = int(layers.size()) - 2; depth >= 0; depth -= 1) {
+            Move mv;
+            if (!predecessor(depth, goal, mv)) {
+                return false;
+            }
+            path.push_back(mv);
+        }
+        std::reverse(path.begin(), path.end());
+        return true;
+    }
+};
+
+} // namespace
+
+bool exhaustive(Position &root, const SearchLimits &limits, std::vector<Move> &path)
+{
+    ExhaustiveSearch search(root, limits);
+    return search.run(path);
+}
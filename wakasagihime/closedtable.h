@@ -0,0 +1,127 @@
+// Chinese Dark Chess: closed table
+// ----------------------------------
+// A flat open-addressing hash table from position keys to search nodes.
+// Its memory is allocated once, so it never rehashes and never throws.
+
+#ifndef CLOSEDTABLE_H
+#define CLOSEDTABLE_H
+
+#include "lib/types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+class ClosedTable {
+    public:
+    struct Entry {
+        Key key;
+        uint32_t index; // node index, NO_NODE until the caller sets it
+        uint16_t g;     // best g so far, NO_COST until the caller sets it
+        uint16_t used;
+    };
+    static_assert(sizeof(Entry) == 16, "Entries should stay 16 bytes");
+
+    static constexpr uint32_t NO_NODE = UINT32_MAX;
+    static constexpr uint16_t NO_COST = UINT16_MAX;
+
+    private:
+    Entry *table;
+    size_t mask;
+    size_t count;
+    size_t limit;
+
+    public:
+    /*
+     * Allocates the table.
+     * @param   bytes   Memory budget. The capacity is the largest power of two that fits.
+     *                  If the allocation fails, smaller tables are tried.
+     */
+    explicit ClosedTable(size_t bytes)
+      : table(nullptr)
+      , mask(0)
+      , count(0)
+      , limit(0)
+    {
+        size_t capacity = 1;
+        while (capacity * 2 * sizeof(Entry) <= bytes) {
+            capacity *= 2;
+        }
+        for (; capacity >= 16 && !table; capacity /= 2) {
+            table = new (std::nothrow) Entry[capacity]();
+            mask  = capacity - 1;
+        }
+        // Linear probing gets slow when crowded, stop taking new keys at 7/8
+        limit = table ? (mask + 1) / 8 * 7 : 0;
+    }
+    ~ClosedTable() { delete[] table; }
+
+    ClosedTable(const ClosedTable &)            = delete;
+    ClosedTable &operator=(const ClosedTable &) = delete;
+
+    /*
+     * Looks up a key.
+     * @param   key The key
+     * @returns Its entry, nullptr if absent
+     */
+    Entry *find(Key key) const
+    {
+        for (size_t i = key & mask; table && table[i].used; i = (i + 1) & mask) {
+            if (table[i].key == key) {
+                return &table[i];
+            }
+        }
+        return nullptr;
+    }
+
+    /*
+     * Looks up a key, adding it if absent.
+     * @param   key The key
+     * @returns Its entry, nullptr if the key is absent and the table is full.
+     *          New entries have index NO_NODE and g NO_COST.
+     */
+    Entry *insert(Key key)
+    {
+        if (!table) {
+            return nullptr;
+        }
+        size_t i = key & mask;
+        for (; table[i].used; i = (i + 1) & mask) {
+            if (table[i].key == key) {
+                return &table[i];
+            }
+        }
+        if (count >= limit) {
+            return nullptr;
+        }
+        count += 1;
+        table[i] = Entry{ key, NO_NODE, NO_COST, 1 };
+        return &table[i];
+    }
+
+    /*
+     * Removes an entry. Later entries of its probe chain are shifted back
+     * into the hole, so no tombstones are left behind.
+     * @param   entry   From find() or insert(). Entry pointers are invalid afterwards.
+     */
+    void erase(Entry *entry)
+    {
+        size_t hole = entry - table;
+        for (size_t i = (hole + 1) & mask; table[i].used; i = (i + 1) & mask) {
+            // An entry may fill the hole unless its home slot lies in (hole, i]
+            size_t home = table[i].key & mask;
+            if (((i - home) & mask) >= ((i - hole) & mask)) {
+                table[hole] = table[i];
+                hole        = i;
+            }
+        }
+        table[hole].used = 0;
+        count -= 1;
+    }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return limit; }
+    bool full() const { return count >= limit; }
+};
+
+#endif
@@ -0,0 +1,408 @@
+// Chinese Dark Chess: external-memory A*
+// ----------------------------------
+// A* for puzzles whose search does not fit in memory. Nodes live on disk in
+// one file per (g, h) bucket, as packed states. Buckets are expanded in the
+// same (f, h) order as astar(). Duplicates are removed by sorting and merging
+// files, so all disk access is sequential.
+//
+// h is a function of the state, so a duplicate of a state in bucket (g, h)
+// can only sit in a bucket with the same h. Moves other than captures can be
+// taken back, which puts the usual duplicates in (g, h), (g - 1, h) and
+// (g - 2, h). Those are the only buckets checked. Captures cannot be taken
+// back, so a state reached again after a capture is just searched twice.
+
+#include "heuristic.h"
+#include "search.h"
+#include "state.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// Records sorted in memory at a time, 16 bytes each
+constexpr size_t RUN_RECORDS = 1 << 14;
+// Files merged at once. Keep it well below the open file limit.
+constexpr size_t MERGE_WAYS = 64;
+
+bool read_state(FILE *file, State &s) { return fread(&s, sizeof(State), 1, file) == 1; }
+
+void write_state(FILE *file, const State &s) { fwrite(&s, sizeof(State), 1, file); }
+
+/*
+ * A sorted file read one record ahead.
+ */
+struct Stream {
+    FILE *file;
+    State head;
+    bool live;
+
+    explicit Stream(const std::string &path)
+      : file(fopen(path.c_str(), "rb"))
+      , head{}
+      , live(false)
+    {
+        advance();
+    }
+    ~Stream()
+    {
+        if (file) {
+            fclose(file);
+        }
+    }
+    Stream(const Stream &)            = delete;
+    Stream &operator=(const Stream &) = delete;
+
+    void advance() { live = file && read_state(file, head); }
+
+    /*
+     * Skips records below _s_.
+     * @returns Whether _s_ itself is in the file
+     */
+    bool seek(const State &s)
+    {
+        while (live && head < s) {
+            advance();
+        }
+        return live && head == s;
+    }
+};
+
+/*
+ * Merges sorted files into one, dropping duplicates. The inputs are deleted.
+ * @returns false if a file could not be opened
+ */
+bool merge(const std::vector<std::string> &inputs, const std::string &output)
+{
+    FILE *out = fopen(output.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+    std::vector<Stream *> streams;
+    for (const std::string &path : inputs) {
+        streams.push_back(new Stream(path));
+    }
+
+    using Head = std::pair<State, size_t>;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    for (size_t i = 0; i < streams.size(); i += 1) {
+        if (streams[i]->live) {
+            heads.push({ streams[i]->head, i });
+        }
+    }
+    bool first = true;
+    State last{};
+    while (!heads.empty()) {
+        auto [s, i] = heads.top();
+        heads.pop();
+        if (first || s != last) {
+            write_state(out, s);
+            last  = s;
+            first = false;
+        }
+        streams[i]->advance();
+        if (streams[i]->live) {
+            heads.push({ streams[i]->head, i });
+        }
+    }
+
+    for (Stream *stream : streams) {
+        delete stream;
+    }
+    for (const std::string &path : inputs) {
+        std::remove(path.c_str());
+    }
+    fclose(out);
+    return true;
+}
+
+struct Bucket {
+    FILE *open;       // unsorted states waiting for expansion, appended to
+    uint64_t pending; // how many
+    bool closed;      // whether a sorted file of expanded states exists
+};
+
+class ExternalSearch {
+    private:
+    Position &root;
+    const SearchLimits &limits;
+    StateCodec codec;
+    std::string dir;
+    std::map<std::pair<int, int>, Bucket> buckets; // by (g, h)
+    int runs;
+    uint64_t nodes;
+
+    std::string file(int g, int h, const char *kind) const
+    {
+        return dir + "/" + std::to_string(g) + "-" + std::to_string(h) + "." + kind;
+    }
+
+    bool append(int g, int h, const State &s)
+    {
+        Bucket &b = buckets[{ g, h }];
+        if (!b.open && !(b.open = fopen(file(g, h, "open").c_str(), "ab"))) {
+            return false;
+        }
+        write_state(b.open, s);
+        b.pending += 1;
+        return true;
+    }
+
+    /*
+     * Sorts a file of states, dropping duplicates.
+     * Sorted runs are cut in memory and merged MERGE_WAYS at a time.
+     */
+    bool sort(const std::string &input, const std::string &output)
+    {
+        FILE *in = fopen(input.c_str(), "rb");
+        if (!in) {
+            return false;
+        }
+        std::vector<std::string> pieces;
+        std::vector<State> run;
+        run.reserve(RUN_RECORDS);
+        State s;
+        bool more = true;
+        while (more) {
+            run.clear();
+            while (run.size() < RUN_RECORDS && (more = read_state(in, s))) {
+                run.push_back(s);
+            }
+            std::sort(run.begin(), run.end());
+            run.erase(std::unique(run.begin(), run.end()), run.end());
+
+            pieces.push_back(dir + "/run" + std::to_string(runs++));
+            FILE *out = fopen(pieces.back().c_str(), "wb");
+            if (!out) {
+                fclose(in);
+                return false;
+            }
+            fwrite(run.data(), sizeof(State), run.size(), out);
+            fclose(out);
+        }
+        fclose(in);
+        std::remove(input.c_str());
+
+        while (pieces.size() > MERGE_WAYS) {
+            std::vector<std::string> merged;
+            for (size_t i = 0; i < pieces.size(); i += MERGE_WAYS) {
+                size_t end = std::min(pieces.size(), i + MERGE_WAYS);
+                merged.push_back(dir + "/run" + std::to_string(runs++));
+                std::vector<std::string> group(pieces.begin() + i, pieces.begin() + end);
+                if (!merge(group, merged.back())) {
+                    return false;
+                }
+            }
+            pieces.swap(merged);
+        }
+        return merge(pieces, output);
+    }
+
+    /*
+     * Finds the move from a state at depth _g_ - 1 to _target_.
+     */
+    bool predecessor(int g, State &target, Move &move)
+    {
+        Position pos;
+        for (auto &[gh, b] : buckets) {
+            if (gh.first != g - 1 || !b.closed) {
+                continue;
+            }
+            Stream stream(file(gh.first, gh.second, "closed"));
+            for (; stream.live; stream.advance()) {
+                codec.decode(stream.head, pos);
+                MoveList<> moves(pos);
+                for (const Move &mv : moves) {
+                    UndoInfo ui;
+                    pos.do_move_unchecked(mv, ui);
+                    bool hit = codec.encode(pos) == target;
+                    pos.undo_move(mv, ui);
+                    if (hit) {
+                        target = stream.head;
+                        move   = mv;
+                        return true;
+                    }
+                }
+            }
+        }
+        return false;
+    }
+
+    /*
+     * Walks back from a goal at depth _g_, scanning one depth at a time.
+     */
+    bool reconstruct(int g, State goal, std::vector<Move> &path)
+    {
+        path.clear();
+        for (; g > 0; g -= 1) {
+            Move mv;
+            if (!predecessor(g, goal, mv)) {
+                return false;
+            }
+            path.push_back(mv);
+        }
+        std::reverse(path.begin(), path.end());
+        return true;
+    }
+
+    /*
+     * Expands bucket (g, h): sorts it, drops what was already expanded,
+     * and appends the children to their buckets.
+     * @returns 1 if a goal was found (and the path filled), 0 to go on, -1 to give up
+     */
+    int expand(int g, int h, std::vector<Move> &path)
+    {
+        Bucket &b = buckets[{ g, h }];
+        fclose(b.open);
+        b.open    = nullptr;
+        b.pending = 0;
+        if (!sort(file(g, h, "open"), file(g, h, "sorted"))) {
+            return -1;
+        }
+
+        Stream fresh(file(g, h, "sorted"));
+        std::vector<Stream *> older;
+        for (int dg = 0; dg <= 2 && dg <= g; dg += 1) {
+            auto it = buckets.find({ g - dg, h });
+            if (it != buckets.end() && it->second.closed) {
+                older.push_back(new Stream(file(g - dg, h, "closed")));
+            }
+        }
+        FILE *out = fopen(file(g, h, "new").c_str(), "wb");
+
+        int result = out ? 0 : -1;
+        Position pos;
+        for (; fresh.live && result == 0; fresh.advance()) {
+            const State &s = fresh.head;
+            bool seen      = false;
+            for (Stream *o : older) {
+                seen = o->seek(s) || seen;
+            }
+            if (seen) {
+                continue;
+            }
+            write_state(out, s);
+
+            codec.decode(s, pos);
+            if (pos.is_hw1_goal()) {
+                result = reconstruct(g, s, path) ? 1 : -1;
+                break;
+            }
+            MoveList<> moves(pos);
+            for (const Move &mv : moves) {
+                if ((++nodes & 1023) == 0 && limits.expired()) {
+                    result = -1;
+                    break;
+                }
+                UndoInfo ui;
+                pos.do_move_unchecked(mv, ui);
+                if (!append(g + 1, heuristic(pos), codec.encode(pos))) {
+                    result = -1;
+                }
+                pos.undo_move(mv, ui);
+            }
+        }
+
+        for (Stream *o : older) {
+            delete o;
+        }
+        if (out) {
+            fclose(out);
+        }
+        if (result != 0) {
+            return result;
+        }
+        std::remove(file(g, h, "sorted").c_str());
+
+        // Fold the new states into what bucket (g, h) has already expanded
+        std::vector<std::string> closed{ file(g, h, "new") };
+        if (b.closed) {
+            std::rename(file(g, h, "closed").c_str(), file(g, h, "old").c_str());
+            closed.push_back(file(g, h, "old"));
+        }
+        b.closed = true;
+        return merge(closed, file(g, h, "closed")) ? 0 : -1;
+    }
+
+    public:
+    ExternalSearch(Position &root, const SearchLimits &limits)
+      : root(root)
+      , limits(limits)
+      , codec(root)
+      , runs(0)
+      , nodes(0)
+    {
+        std::error_code ec;
+        std::string pattern = (fs::temp_directory_path(ec) / "wakasagi-XXXXXX").string();
+        if (mkdtemp(pattern.data())) {
+            dir = pattern;
+        }
+    }
+    ~ExternalSearch()
+    {
+        for (auto &[gh, b] : buckets) {
+            if (b.open) {
+                fclose(b.open);
+            }
+        }
+        if (!dir.empty()) {
+            std::error_code ec;
+            fs::remove_all(dir, ec);
+        }
+    }
+
+    ExternalSearch(const ExternalSearch &)            = delete;
+    ExternalSearch &operator=(const ExternalSearch &) = delete;
+
+    bool run(std::vector<Move> &path)
+    {
+        if (dir.empty()) {
+            LOG(LOG_ERROR, debug) << "External A*: cannot create a temporary directory\n";
+            return false;
+        }
+        if (!append(0, heuristic(root), codec.encode(root))) {
+            return false;
+        }
+        while (true) {
+            // Lowest f first, then lowest h, like the in-memory open list
+            const std::pair<int, int> *best = nullptr;
+            for (const auto &[gh, b] : buckets) {
+                if (b.pending == 0) {
+                    continue;
+                }
+                if (!best || gh.first + gh.second < best->first + best->second
+                    || (gh.first + gh.second == best->first + best->second && gh.second < best->second)) {
+                    best = &gh;
+                }
+            }
+            if (!best) {
+                return false;
+            }
+            auto [g, h] = *best;
+            DBG << "External A*: bucket g = " << g << ", h = " << h << ", "
+                << buckets[*best].pending << " states\n";
+            int result = expand(g, h, path);
+            if (result != 0) {
+                return result > 0;
+            }
+        }
+    }
+};
+
+} // namespace
+
+bool external(Position &root, const SearchLimits &limits, std::vector<Move> &path)
+{
+    ExternalSearch search(root, limits);
+    return search.run(path);
+}
@@ -0,0 +1,281 @@
+// Chinese Dark Chess: frontier search
+// ----------------------------------
+// Breadth-first heuristic search that keeps no closed list. Only three layers
+// are alive at a time: the one being expanded, the one before it (to catch
+// moves straight back) and the one being generated. There are no parent links
+// either. Instead every node past a middle "relay" layer remembers its ancestor
+// there, and the path is rebuilt by solving the two halves again, recursively.
+//
+// The bound grows like IDA* (breadth-first iterative deepening A*), so the
+// answer is at least as short as the one A* finds with the same heuristic.
+//
+// The layers are reserved up front from the memory limit and never grow, so
+// a search that outgrows them gives up instead of failing an allocation.
+
+#include "heuristic.h"
+#include "search.h"
+#include "state.h"
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace {
+
+// Cost for states that cannot reach the target at all
+constexpr int UNREACHABLE = 1000;
+// Layers alive at a time
+constexpr int LAYERS = 3;
+
+struct Entry {
+    State state;
+    State relay; // ancestor in the relay layer, unset before it
+
+    bool operator<(const Entry &other) const { return state < other.state; }
+    bool operator==(const Entry &other) const { return state == other.state; }
+};
+
+using Layer = std::vector<Entry>;
+
+/*
+ * Sorts a layer and drops duplicate states, keeping any one relay.
+ */
+void compact(Layer &layer)
+{
+    std::sort(layer.begin(), layer.end());
+    layer.erase(std::unique(layer.begin(), layer.end()), layer.end());
+}
+
+bool contains(const Layer &layer, const State &s)
+{
+    return std::binary_search(layer.begin(), layer.end(), Entry{ s, State{} });
+}
+
+/*
+ * What a search is looking for: a HW1 win, or one exact state.
+ */
+class Goal {
+    private:
+    bool exact;
+    State target;
+    Board black[MOVABLE_PIECE_TYPE_NB]; // target squares by type
+    Board red;                          // red pieces still alive in the target
+
+    public:
+    // Any winning position
+    Goal()
+      : exact(false)
+      , target{}
+      , black{}
+      , red(0)
+    {}
+
+    // Exactly _s_
+    Goal(const StateCodec &codec, const State &s)
+      : exact(true)
+      , target(s)
+      , black{}
+    {
+        Position pos;
+        codec.decode(s, pos);
+        for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+            black[pt] = pos.pieces(Black, pt);
+        }
+        red = pos.pieces(Red);
+    }
+
+    bool reached(const State &s, const Position &pos) const
+    {
+        return exact ? s == target : pos.is_hw1_goal();
+    }
+
+    /*
+     * Lower bound on the moves to the target. Each move takes one black piece
+     * off one square and captures at most one red piece, so neither the
+     * misplaced pieces nor the red pieces left to capture can drop faster.
+     */
+    int estimate(const Position &pos) const
+    {
+        if (!exact) {
+            return heuristic(pos);
+        }
+        if (red & ~pos.pieces(Red)) {
+            return UNREACHABLE; // captured a piece the target still has
+        }
+        int misplaced = 0;
+        for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+            misplaced += __builtin_popcount(pos.pieces(Black, pt) & ~black[pt]);
+        }
+        int captures = __builtin_popcount(pos.pieces(Red) & ~red);
+        return std::max(misplaced, captures);
+    }
+};
+
+struct Result {
+    int depth;      // of the goal, -1 if none within the bound
+    State goal;
+    int relayDepth; // min(requested relay depth, depth)
+    State relay;    // the goal's ancestor at relayDepth
+    int next;       // smallest f that went over the bound
+};
+
+class FrontierSearch {
+    private:
+    Position &root;
+    const SearchLimits &limits;
+    StateCodec codec;
+    size_t layerRoom; // entries each layer is reserved for
+    uint64_t nodes;
+    bool timeout;
+    bool full; // a layer outgrew layerRoom
+
+    /*
+     * Breadth-first search from _start_, pruning every node with f > _bound_.
+     * @param   relayDepth  Depth of the layer whose states are remembered
+     */
+    Result search(const State &start, const Goal &goal, int bound, int relayDepth)
+    {
+        Result result{ -1, State{}, 0, State{}, UNREACHABLE };
+        Layer prev, cur, next;
+        prev.reserve(layerRoom);
+        cur.reserve(layerRoom);
+        next.reserve(layerRoom);
+        if (layerRoom == 0) {
+            full = true;
+            return result;
+        }
+        cur.push_back(Entry{ start, relayDepth == 0 ? start : State{} });
+
+        Position pos;
+        for (int depth = 0; !cur.empty(); depth += 1) {
+            DBG << "Frontier: depth " << depth << ", " << cur.size() << " states\n";
+            size_t compacted = 0;
+            for (const Entry &e : cur) {
+                codec.decode(e.state, pos);
+                MoveList<> moves(pos);
+                for (const Move &mv : moves) {
+                    if ((++nodes & 1023) == 0 && limits.expired()) {
+                        timeout = true;
+                        return result;
+                    }
+                    UndoInfo ui;
+                    pos.do_move_unchecked(mv, ui);
+                    State child  = codec.encode(pos);
+                    int f        = depth + 1 + goal.estimate(pos);
+                    bool reached = goal.reached(child, pos);
+                    pos.undo_move(mv, ui);
+
+                    if (f > bound) {
+                        result.next = std::min(result.next, f);
+                        continue;
+                    }
+                    if (contains(prev, child) || contains(cur, child)) {
+                        continue;
+                    }
+                    State relay = depth + 1 == relayDepth ? child : e.relay;
+                    if (reached) {
+                        result.depth      = depth + 1;
+                        result.goal       = child;
+                        result.relayDepth = std::min(relayDepth, depth + 1);
+                        result.relay      = depth + 1 < relayDepth ? child : relay;
+                        return result;
+                    }
+                    // Keep the duplicates from piling up within the layer
+                    if (next.size() >= 2 * compacted + 4096 || next.size() == next.capacity()) {
+                        compact(next);
+                        compacted = next.size();
+                        // Compacting again and again would take longer than it is worth
+                        if (next.size() + next.capacity() / 8 >= next.capacity()) {
+                            full = true;
+                            return result;
+                        }
+                    }
+                    next.push_back(Entry{ child, relay });
+                }
+            }
+            compact(next);
+            prev.swap(cur);
+            cur.swap(next);
+            next.clear();
+        }
+        return result;
+    }
+
+    /*
+     * Appends the moves of a shortest path from _start_ to _target_.
+     * @param   depth   Length of some path between them
+     * @returns false on timeout or when out of memory
+     */
+    bool reconstruct(const State &start, const State &target, int depth, std::vector<Move> &path)
+    {
+        if (depth == 0) {
+            return true;
+        }
+        if (depth == 1) {
+            Position pos;
+            codec.decode(start, pos);
+            MoveList<> moves(pos);
+            for (const Move &mv : moves) {
+                UndoInfo ui;
+                pos.do_move_unchecked(mv, ui);
+                bool hit = codec.encode(pos) == target;
+                pos.undo_move(mv, ui);
+                if (hit) {
+                    path.push_back(mv);
+                    return true;
+                }
+            }
+            assert(false && "the target is one move away");
+            return false;
+        }
+
+        Result r = search(start, Goal(codec, target), depth, depth / 2);
+        if (r.depth < 0) {
+            return false;
+        }
+        return reconstruct(start, r.relay, r.relayDepth, path)
+            && reconstruct(r.relay, target, r.depth - r.relayDepth, path);
+    }
+
+    public:
+    FrontierSearch(Position &root, const SearchLimits &limits)
+      : root(root)
+      , limits(limits)
+      , codec(root)
+      , layerRoom(limits.memory_limit() / (LAYERS * sizeof(Entry)))
+      , nodes(0)
+      , timeout(false)
+      , full(false)
+    {}
+
+    bool run(std::vector<Move> &path)
+    {
+        State start = codec.encode(root);
+        Goal win;
+        for (int bound = heuristic(root); bound < UNREACHABLE;) {
+            DBG << "Frontier: bound = " << bound << "\n";
+            Result r = search(start, win, bound, bound / 2);
+            if (full) {
+                DBG << "Frontier: out of memory, " << layerRoom << " states per layer\n";
+            }
+            if (timeout || full) {
+                return false;
+            }
+            if (r.depth >= 0) {
+                path.clear();
+                return reconstruct(start, r.relay, r.relayDepth, path)
+                    && reconstruct(r.relay, r.goal, r.depth - r.relayDepth, path);
+            }
+            bound = r.next;
+        }
+        return false;
+    }
+};
+
+} // namespace
+
+bool frontier(Position &root, const SearchLimits &limits, std::vector<Move> &path)
+{
+    FrontierSearch search(root, limits);
+    return search.run(path);
+}
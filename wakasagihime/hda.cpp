@@ -0,0 +1,418 @@
+// Chinese Dark Chess: HDA*
+// ----------------------------------
+// Hash-distributed A*. Every position belongs to one thread, picked by its
+// Zobrist key, and only that thread keeps it in its open list and closed
+// table. A generated child is sent to its owner in batches, through a
+// lock-free inbox, so no table is ever shared or locked.
+//
+// A goal only sets an incumbent. The search is over when every thread is
+// idle (nothing in its open list below the incumbent) and no batch is in
+// flight. At that point no open node can beat the incumbent, which is the
+// same guarantee A* gives when it pops a goal. Both counts share one atomic
+// word, so that they are always read at the same instant.
+
+#include "closedtable.h"
+#include "heuristic.h"
+#include "nodestore.h"
+#include "openlist.h"
+#include "search.h"
+#include "state.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace {
+
+// What a thread costs besides its nodes: its stack, its move lists and its
+// batches in flight. Threads take at most half the budget, their nodes the rest.
+constexpr size_t THREAD_BYTES = 1 << 20;
+constexpr int MAX_THREADS     = 64;
+// Children sent to one thread at a time
+constexpr uint32_t BATCH_SIZE = 64;
+// Expansions between two flushes of the partly filled batches
+constexpr int FLUSH_EVERY = 16;
+
+constexpr uint32_t NO_NODE = UINT32_MAX;
+
+// HDAStarSearch::activity: idle threads in the low bits, children in flight above
+constexpr int IDLE_BITS      = 8;
+constexpr uint64_t IDLE      = 1;
+constexpr uint64_t IN_FLIGHT = uint64_t(1) << IDLE_BITS;
+static_assert(MAX_THREADS < IN_FLIGHT, "idle threads must not carry into the children in flight");
+
+struct Node {
+    uint32_t parent;      // index in the parent's owner
+    uint8_t parentThread;
+    Move mv;              // from the parent
+    uint16_t g;
+    uint16_t h;
+};
+
+// Memory a stored node takes: its record, its state, its open list slot, and
+// two closed table entries since the table is a power of two that fills up to 7/8
+constexpr size_t NODE_BYTES = sizeof(Node) + sizeof(State) + 2 * sizeof(uint32_t) + 2 * sizeof(ClosedTable::Entry);
+
+struct Message {
+    State state;
+    Key key;
+    uint32_t parent;
+    uint8_t parentThread;
+    Move mv;
+    uint16_t g;
+    uint16_t h;
+};
+
+struct Batch {
+    Batch *next;
+    uint32_t count;
+    Message items[BATCH_SIZE];
+};
+
+/*
+ * Many writers push batches, the owner takes them all at once.
+ * Taking everything with one exchange means a popped batch is never
+ * looked at by anyone else, so there is no ABA problem.
+ */
+class Inbox {
+    private:
+    std::atomic<Batch *> head{ nullptr };
+
+    public:
+    void push(Batch *b)
+    {
+        b->next = head.load(std::memory_order_relaxed);
+        while (!head.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+    Batch *take() { return head.exchange(nullptr, std::memory_order_acquire); }
+    bool empty() const { return head.load(std::memory_order_relaxed) == nullptr; }
+};
+
+class HDAStarSearch;
+
+struct Worker {
+    HDAStarSearch *search;
+    int id;
+    ClosedTable closed;
+    NodeArena<Node> nodes;
+    NodeArena<State> states;
+    BucketQueue<uint32_t> open;
+    Batch *outbox[MAX_THREADS];
+    Inbox inbox;
+
+    Worker(HDAStarSearch *search, int id, size_t bytes)
+      : search(search)
+      , id(id)
+      , closed(bytes / NODE_BYTES * 2 * sizeof(ClosedTable::Entry))
+      , outbox{}
+    {}
+    ~Worker()
+    {
+        for (Batch *b : outbox) {
+            delete b;
+        }
+        for (Batch *b = inbox.take(); b;) {
+            Batch *next = b->next;
+            delete b;
+            b = next;
+        }
+    }
+};
+
+class HDAStarSearch {
+    private:
+    Position &root;
+    const SearchLimits &limits;
+    StateCodec codec;
+    Worker *workers[MAX_THREADS];
+    int threads;
+
+    std::atomic<bool> go{ false };
+    std::atomic<bool> done{ false };
+    std::atomic<bool> timeout{ false };
+    std::atomic<bool> full{ false }; // a thread ran out of memory
+    // Idle threads, plus IN_FLIGHT per child sent but not yet taken in. A thread
+    // is counted idle only with nothing to send, and leaves that count before
+    // taking anything in, so all idle and nothing in flight at once means done.
+    std::atomic<uint64_t> activity{ 0 };
+
+    // Incumbent
+    std::atomic<int> bestCost{ INT_MAX };
+    std::mutex bestLock;
+    int bestThread;
+    uint32_t bestIndex;
+
+    int owner(Key key) const { return int((key >> 32) % uint64_t(threads)); }
+
+    /*
+     * Ends the search. Dropping a child instead could cost the optimal answer.
+     */
+    void out_of_memory(const Worker &w)
+    {
+        DBG << "HDA*: thread " << w.id << " out of memory after " << w.nodes.size() << " nodes\n";
+        full = true;
+        done = true;
+    }
+
+    /*
+     * Takes a child into worker _w_, if it is new or reached more cheaply.
+     */
+    void receive(Worker &w, const Message &m)
+    {
+        ClosedTable::Entry *seen = w.closed.insert(m.key);
+        if (!seen) {
+            out_of_memory(w);
+            return;
+        }
+        if (seen->g <= m.g) {
+            return;
+        }
+        uint32_t index = w.nodes.push(Node{ m.parent, m.parentThread, m.mv, m.g, m.h });
+        if (index != NodeArena<Node>::NONE && w.states.push(m.state) == NodeArena<State>::NONE) {
+            w.nodes.pop_back();
+            index = NodeArena<Node>::NONE;
+        }
+        if (index == NodeArena<Node>::NONE) {
+            out_of_memory(w);
+            return;
+        }
+        seen->index = index;
+        seen->g     = m.g;
+        w.open.push(index, m.g + m.h, m.h);
+    }
+
+    void flush(Worker &w, int to)
+    {
+        Batch *b = w.outbox[to];
+        if (b && b->count) {
+            activity.fetch_add(b->count * IN_FLIGHT);
+            workers[to]->inbox.push(b);
+            w.outbox[to] = nullptr;
+        }
+    }
+
+    void flush_all(Worker &w)
+    {
+        for (int t = 0; t < threads; t += 1) {
+            flush(w, t);
+        }
+    }
+
+    void send(Worker &w, const Message &m)
+    {
+        int to = owner(m.key);
+        if (to == w.id) {
+            receive(w, m);
+            return;
+        }
+        Batch *&b = w.outbox[to];
+        if (!b && !(b = new (std::nothrow) Batch())) {
+            out_of_memory(w);
+            return;
+        }
+        b->items[b->count++] = m;
+        if (b->count == BATCH_SIZE) {
+            flush(w, to);
+        }
+    }
+
+    /*
+     * @returns Whether messages were taken in
+     */
+    bool drain(Worker &w)
+    {
+        Batch *b = w.inbox.take();
+        if (!b) {
+            return false;
+        }
+        while (b) {
+            for (uint32_t i = 0; i < b->count; i += 1) {
+                receive(w, b->items[i]);
+            }
+            // Only now, so that nobody sees the search as finished in between
+            activity.fetch_sub(b->count * IN_FLIGHT);
+            Batch *next = b->next;
+            delete b;
+            b = next;
+        }
+        return true;
+    }
+
+    void expand(Worker &w)
+    {
+        uint32_t index = w.open.pop();
+        Node cur       = w.nodes[index];
+        Position pos;
+        codec.decode(w.states[index], pos);
+        if (w.closed.find(pos.key())->index != index) {
+            return; // stale, a cheaper path was found later
+        }
+        if (pos.is_hw1_goal()) {
+            std::lock_guard<std::mutex> lock(bestLock);
+            if (cur.g < bestCost.load()) {
+                bestThread = w.id;
+                bestIndex  = index;
+                bestCost.store(cur.g);
+            }
+            return;
+        }
+        HeuristicCache cache, child;
+        heuristic(pos, cache);
+        MoveList<> moves(pos);
+        for (const Move &mv : moves) {
+            UndoInfo ui;
+            pos.do_move_unchecked(mv, ui);
+            int h = heuristic_after(pos, cache, mv, child);
+            if (cur.g + 1 + h < bestCost.load(std::memory_order_relaxed)) {
+                send(w, Message{ codec.encode(pos), pos.key(), index, uint8_t(w.id), mv, uint16_t(cur.g + 1),
+                                 uint16_t(h) });
+            }
+            pos.undo_move(mv, ui);
+        }
+    }
+
+    bool has_work(Worker &w) const
+    {
+        return !w.open.empty() && w.open.min_f() < bestCost.load(std::memory_order_relaxed);
+    }
+
+    void work(Worker &w)
+    {
+        int expansions = 0;
+        while (!done.load(std::memory_order_relaxed)) {
+            drain(w);
+            if (has_work(w)) {
+                expand(w);
+                if (++expansions % FLUSH_EVERY == 0) {
+                    flush_all(w);
+                    if (limits.expired()) {
+                        timeout = true;
+                        done    = true;
+                    }
+                }
+                continue;
+            }
+
+            // Idle until a batch arrives or everybody is idle
+            flush_all(w);
+            activity.fetch_add(IDLE);
+            while (true) {
+                if (!w.inbox.empty()) {
+                    activity.fetch_sub(IDLE);
+                    break;
+                }
+                if (activity.load() == threads * IDLE) {
+                    done = true;
+                    break;
+                }
+                if (done.load()) {
+                    break;
+                }
+                if (limits.expired()) {
+                    timeout = true;
+                    done    = true;
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    static void *entry(void *arg)
+    {
+        Worker *w = static_cast<Worker *>(arg);
+        while (!w->search->go.load()) {
+            std::this_thread::yield();
+        }
+        w->search->work(*w);
+        return nullptr;
+    }
+
+    public:
+    HDAStarSearch(Position &root, const SearchLimits &limits)
+      : root(root)
+      , limits(limits)
+      , codec(root)
+      , workers{}
+      , threads(0)
+      , bestThread(0)
+      , bestIndex(NO_NODE)
+    {}
+    ~HDAStarSearch()
+    {
+        for (Worker *w : workers) {
+            delete w;
+        }
+    }
+
+    HDAStarSearch(const HDAStarSearch &)            = delete;
+    HDAStarSearch &operator=(const HDAStarSearch &) = delete;
+
+    bool run(std::vector<Move> &path)
+    {
+        // One thread per core, as long as the address space limit allows,
+        // and the nodes share what the threads leave
+        size_t budget = limits.memory_limit();
+        size_t room   = budget / (2 * THREAD_BYTES);
+        int wanted    = std::clamp<int>(std::min<size_t>(std::thread::hardware_concurrency(), room), 1, MAX_THREADS);
+        size_t nodes  = budget > wanted * THREAD_BYTES ? budget - wanted * THREAD_BYTES : 0;
+        for (int t = 0; t < wanted; t += 1) {
+            workers[t] = new (std::nothrow) Worker(this, t, nodes / wanted);
+            if (!workers[t]) {
+                wanted = t;
+                break;
+            }
+        }
+        if (wanted == 0) {
+            return false;
+        }
+
+        // The calling thread is worker 0. The partition is fixed once we
+        // know how many of the others could actually be started.
+        pthread_t handles[MAX_THREADS];
+        int started = 1;
+        for (; started < wanted; started += 1) {
+            if (!start_thread(handles[started], entry, workers[started])) {
+                break;
+            }
+        }
+        threads = started;
+        DBG << "HDA*: " << threads << " threads\n";
+
+        Worker &first = *workers[0];
+        Message start{ codec.encode(root), root.key(), NO_NODE, 0, Move(), 0, uint16_t(heuristic(root)) };
+        send(first, start);
+        flush_all(first);
+        go = true;
+        work(first);
+        for (int t = 1; t < started; t += 1) {
+            pthread_join(handles[t], nullptr);
+        }
+
+        if (timeout || full || bestIndex == NO_NODE) {
+            return false;
+        }
+        path.clear();
+        int t          = bestThread;
+        uint32_t index = bestIndex;
+        while (workers[t]->nodes[index].parent != NO_NODE) {
+            const Node &n = workers[t]->nodes[index];
+            path.push_back(n.mv);
+            index = n.parent;
+            t     = n.parentThread;
+        }
+        std::reverse(path.begin(), path.end());
+        return true;
+    }
+};
+
+} // namespace
+
+bool hdastar(Position &root, const SearchLimits &limits, std::vector<Move> &path)
+{
+    HDAStarSearch search(root, limits);
+    return search.run(path);
+}
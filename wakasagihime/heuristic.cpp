@@ -0,0 +1,226 @@
+#include "heuristic.h"
+#include <algorithm>
+#include <vector>
+
+// Moves a piece needs to capture on a square, with only the ducks on the board.
+// Other pieces come and go, so they are left out.
+enum DistanceClass { STEP, SLIDE, JUMP, DISTANCE_CLASS_NB };
+static uint8_t dist_table[DISTANCE_CLASS_NB][SQUARE_NB][SQUARE_NB];
+
+static DistanceClass distance_class(PieceType pt){
+    if(pt == Chariot)
+        return SLIDE;
+    if(pt == Cannon)
+        return JUMP;
+    return STEP;
+}
+
+// one move of each class with only the ducks known: squares it may move to, squares it may capture on
+static Board move_table[DISTANCE_CLASS_NB][SQUARE_NB];
+static Board capture_table[DISTANCE_CLASS_NB][SQUARE_NB];
+
+// squares a piece of class c can move to from sq without capturing
+static Board quiet_moves(DistanceClass c, Square sq, Board ducks){
+    if(c == STEP)
+        return PseudoAttacks[sq] & ~ducks;
+    Board moves = attacks_bb<Chariot>(sq, ducks) & ~ducks;
+    if(c == JUMP){// cannons slide like chariots, and may also land on a piece behind a duck
+        for(Square to: BoardView(~ducks & ~square_bb(sq))){
+            if(attacks_bb<Cannon>(sq, ducks | square_bb(to)) & to)
+                moves |= to;
+        }
+    }
+    return moves;
+}
+
+// whether a piece of class c on from can capture on to
+static bool captures(DistanceClass c, Square from, Square to, Board ducks){
+    Board occupied = ducks | square_bb(to);
+    if(c == STEP)
+        return PseudoAttacks[from] & to;
+    if(c == SLIDE)
+        return attacks_bb<Chariot>(from, occupied) & to;
+    if(attacks_bb<Cannon>(from, occupied) & to)// a duck is the screen
+        return true;
+    // nothing in between, some other piece may turn up as the screen
+    return (attacks_bb<Chariot>(from, occupied) & to) && distance<Square>(from, to) > 1;
+}
+
+void heuristic_init(const Position &root){
+    tour_reset();// they were walked around the last puzzle's ducks
+    Board ducks = root.pieces(Duck);
+    for(int c = 0; c < DISTANCE_CLASS_NB; c++){
+        for(int sq = 0; sq < SQUARE_NB; sq++){
+            move_table[c][sq] = 0;
+            capture_table[c][sq] = 0;
+            if(ducks & Square(sq))
+                continue;
+            move_table[c][sq] = quiet_moves(DistanceClass(c), Square(sq), ducks);
+            for(Square to: BoardView(~ducks & ~square_bb(Square(sq)))){
+                if(captures(DistanceClass(c), Square(sq), to, ducks))
+                    capture_table[c][sq] |= to;
+            }
+        }
+    }
+    for(int c = 0; c < DISTANCE_CLASS_NB; c++){
+        for(int to = 0; to < SQUARE_NB; to++){
+            uint8_t *dist = dist_table[c][to];
+            std::fill(dist, dist + SQUARE_NB, NO_CAPTURE);
+            if(ducks & Square(to))
+                continue;
+            // BFS backwards from the capture, quiet moves are symmetric
+            std::vector<Square> queue;
+            dist[to] = 0;
+            for(int from = 0; from < SQUARE_NB; from++){
+                if(capture_table[c][from] & Square(to)){
+                    dist[from] = 1;
+                    queue.push_back(Square(from));
+                }
+            }
+            for(size_t i = 0; i < queue.size(); i++){
+                for(Square next: BoardView(move_table[c][queue[i]])){
+                    if(dist[next] == NO_CAPTURE){
+                        dist[next] = dist[queue[i]] + 1;
+                        queue.push_back(next);
+                    }
+                }
+            }
+        }
+    }
+    if(HEURISTIC == Pattern)
+        pattern_init(root);
+}
+
+Board relaxed_moves(PieceType pt, Square from){
+    return move_table[distance_class(pt)][from];
+}
+
+Board relaxed_captures(PieceType pt, Square from){
+    return capture_table[distance_class(pt)][from];
+}
+
+int capture_distance(PieceType pt, Square from, Square to){
+    return dist_table[distance_class(pt)][to][from];
+}
+
+int capture_leg(PieceType pt, Square from, Square to){
+    int d = capture_distance(pt, from, to);
+    return d == NO_CAPTURE ? NO_LEG : d;
+}
+
+// the closest black piece that can capture the red piece on red_sq, and how many moves it needs
+static void best_attacker(const Position &pos, Square red_sq, Board black_board, uint16_t &min_step, int8_t &best_attack){
+    Piece target = pos.peek_piece_at(red_sq);
+    min_step = 1000;
+    best_attack = -1;
+    for(Square black_sq: BoardView(black_board)){
+        Piece attacker = pos.peek_piece_at(black_sq);
+        if(attacker.type == Duck || !(attacker.type > target.type))
+            continue;
+
+        uint8_t dist = dist_table[distance_class(attacker.type)][red_sq][black_sq];
+        int cur_step = (dist == NO_CAPTURE ? 1000 : dist);
+
+        if(min_step > cur_step){// ties go to the lowest square
+            min_step = cur_step;
+            best_attack = black_sq;
+        }
+    }
+}
+
+// adds up the per-target steps, in square order
+static int fold(const HeuristicCache &cache){
+    int sum = 0;
+    int used[SQUARE_NB];
+    std::fill(used, used + SQUARE_NB, -1);
+    for(int i = 0; i < cache.count; i++){
+        int min_step = cache.step[i];
+        int best_attack = cache.attacker[i];
+        if(best_attack != -1){
+            if(used[best_attack] != -1){
+                if(used[best_attack] > min_step){// may be sequentially reached
+                    min_step = 0;
+                }
+                else if(used[best_attack] == min_step){
+                    min_step = 1;
+                }
+                else{// used[best_attack] < min_step
+                    int prev = used[best_attack];
+                    used[best_attack] = min_step;
+                    min_step -= prev;
+                }
+            }
+            else{
+                used[best_attack] = min_step;
+            }
+        }
+        sum += (min_step == 1000 ? 20 : min_step);
+    }
+    return sum;
+}
+
+// the lower bounds, once the legs of pos are in the cache
+static int admissible(const Position &pos, const HeuristicCache &cache){
+    if(HEURISTIC == Assignment)
+        return assignment_heuristic(cache);
+    if(HEURISTIC == Tour)// both are lower bounds
+        return std::max(assignment_heuristic(cache), tour_heuristic(cache));
+    return std::max({assignment_heuristic(cache), tour_heuristic(cache), pattern_heuristic(pos)});
+}
+
+int heuristic(const Position& pos, HeuristicCache &cache) {
+    if(HEURISTIC != Greedy){
+        assignment_legs(pos, cache);
+        return admissible(pos, cache);
+    }
+    Board red_board = pos.pieces(Red);// squares_sorted
+    Board black_board = pos.pieces(Black);
+    cache.count = 0;
+    for(Square red_sq: BoardView(red_board)){
+        int i = cache.count++;
+        cache.target[i] = red_sq;
+        best_attacker(pos, red_sq, black_board, cache.step[i], cache.attacker[i]);
+    }
+    return fold(cache);
+}
+
+int heuristic(const Position& pos) {
+    HeuristicCache cache;
+    return heuristic(pos, cache);
+}
+
+int heuristic_after(const Position &child, const HeuristicCache &parent, const Move &mv, HeuristicCache &cache){
+    if(HEURISTIC != Greedy){
+        assignment_legs_after(child, parent, mv, cache);
+        return admissible(child, cache);
+    }
+    Square from = mv.from();
+    Square to = mv.to();
+    PieceType mover = child.peek_piece_at(to).type;
+    Board black_board = child.pieces(Black);
+    cache.count = 0;
+    for(int i = 0; i < parent.count; i++){
+        Square red_sq = parent.target[i];
+        if(red_sq == to)// captured
+            continue;
+        int j = cache.count++;
+        cache.target[j] = red_sq;
+        if(parent.attacker[i] == from){// its attacker left, look at every black piece again
+            best_attacker(child, red_sq, black_board, cache.step[j], cache.attacker[j]);
+            continue;
+        }
+        // everybody else stayed put, only the moved piece can do better
+        cache.step[j] = parent.step[i];
+        cache.attacker[j] = parent.attacker[i];
+        if(!(mover > child.peek_piece_at(red_sq).type))
+            continue;
+        uint8_t dist = dist_table[distance_class(mover)][red_sq][to];
+        if(dist == NO_CAPTURE)
+            continue;
+        if(dist < cache.step[j] || (dist == cache.step[j] && to < cache.attacker[j])){
+            cache.step[j] = dist;
+            cache.attacker[j] = to;
+        }
+    }
+    return fold(cache);
+}
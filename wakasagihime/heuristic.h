@@ -0,0 +1,128 @@
+// Chinese Dark Chess: heuristics
+// ----------------------------------
+// Estimates of how many moves black still needs.
+
+#ifndef HEURISTIC_H
+#define HEURISTIC_H
+
+#include "lib/chess.h"
+
+// Heuristics
+enum HeuristicKind {
+    Greedy,     // closest attacker per red piece, shared attackers discounted; can overestimate
+    Assignment, // cheapest assignment of capture legs, a lower bound
+    Tour,       // Assignment, or the capture tours some pieces cannot avoid if that is more
+    Pattern,    // Tour, or the sum of additive pattern databases if that is more
+};
+
+#ifndef HEURISTIC
+#define HEURISTIC Tour
+#endif
+
+// Whether heuristic() never overestimates. Only then is the first goal a search reaches at some f a shortest one.
+constexpr bool ADMISSIBLE = HEURISTIC != Greedy;
+
+// capture_distance() of a piece that can never capture on the square
+constexpr int NO_CAPTURE = 255;
+// capture_leg() of the same. Large enough that no bound counts on it, small enough to add up.
+constexpr int NO_LEG = 1000;
+
+/*
+ * Builds the distance tables heuristic() reads, once per puzzle.
+ * Ducks never move and cannot be captured, so they are walls for the whole search.
+ * @param   root    The initial puzzle
+ */
+void heuristic_init(const Position &root);
+
+/*
+ * Moves a piece needs to capture on a square, with only the ducks in the way.
+ * @param   pt      The capturing piece
+ * @param   from    Where it stands
+ * @param   to      The square it captures on
+ * @returns NO_CAPTURE if the ducks wall it off
+ */
+int capture_distance(PieceType pt, Square from, Square to);
+int capture_leg(PieceType pt, Square from, Square to); // NO_LEG instead of NO_CAPTURE
+
+/*
+ * One move of a piece with only the ducks known, a superset of its real moves.
+ * The distance tables are walked with these.
+ * relaxed_moves()      Squares it may move to without capturing
+ * relaxed_captures()   Squares it may capture on
+ * @param   pt      The piece
+ * @param   from    Where it stands
+ */
+Board relaxed_moves(PieceType pt, Square from);
+Board relaxed_captures(PieceType pt, Square from);
+
+// Most pieces a side has
+constexpr int SIDE_PIECE_NB = 16;
+
+/*
+ * What heuristic() works out for each red piece, so that a child's estimate can
+ * start from its parent's. Lives on the stack, nothing is allocated.
+ */
+struct HeuristicCache {
+    // Greedy
+    int count;
+    Square target[SQUARE_NB];   // red pieces, ascending
+    int8_t attacker[SQUARE_NB]; // the closest black piece that can capture it, -1 if none
+    uint16_t step[SQUARE_NB];   // moves that piece needs
+
+    // The others: the pieces, and the capture legs between them, see assignment.cpp
+    int reds, blacks;
+    Square red[SIDE_PIECE_NB], black[SIDE_PIECE_NB];
+    PieceType redType[SIDE_PIECE_NB], blackType[SIDE_PIECE_NB];
+    uint16_t leg[SIDE_PIECE_NB][2 * SIDE_PIECE_NB]; // red r from black b, then from red p at column blacks + p
+};
+
+/*
+ * Estimated number of moves to capture every red piece.
+ * @param   pos     The position, black to play
+ * @param   cache   If given, filled for heuristic_after()
+ */
+int heuristic(const Position &pos);
+int heuristic(const Position &pos, HeuristicCache &cache);
+
+/*
+ * heuristic() of a child, from its parent's cache. Greedy only looks again at the
+ * red pieces whose closest attacker moved, the others only at the mover's legs.
+ * @param   child   The position after _mv_
+ * @param   parent  The cache of the position before _mv_
+ * @param   mv      The move
+ * @param   cache   Filled for _child_, must not be _parent_
+ */
+int heuristic_after(const Position &child, const HeuristicCache &parent, const Move &mv, HeuristicCache &cache);
+
+/*
+ * The capture legs of a cache, see assignment.cpp.
+ * assignment_legs()        Fills them for _pos_
+ * assignment_legs_after()  Fills them for _child_ from its parent's, as heuristic_after() does
+ */
+void assignment_legs(const Position &pos, HeuristicCache &cache);
+void assignment_legs_after(const Position &child, const HeuristicCache &parent, const Move &mv, HeuristicCache &cache);
+
+/*
+ * The Assignment heuristic, see assignment.cpp.
+ * @param   cache   With the legs of the position filled in
+ */
+int assignment_heuristic(const HeuristicCache &cache);
+
+/*
+ * The capture tours of the Tour heuristic, see tour.cpp.
+ * tour_reset() forgets the tours of the last puzzle, heuristic_init() calls it.
+ * @param   cache   With the legs of the position filled in
+ */
+int tour_heuristic(const HeuristicCache &cache);
+void tour_reset();
+
+/*
+ * The pattern databases of the Pattern heuristic, see pattern.cpp.
+ * pattern_init() builds them for a puzzle, heuristic_init() calls it.
+ * @param   root    The initial puzzle
+ * @param   pos     The position, black to play
+ */
+void pattern_init(const Position &root);
+int pattern_heuristic(const Position &pos);
+
+#endif
@@ -0,0 +1,241 @@
+// Chinese Dark Chess: IDA*
+// ----------------------------------
+// Iterative deepening A*. Moves are made and taken back in place, and the only
+// tables are the current path and a fixed-size transposition table, so memory
+// does not grow with the search.
+//
+// With an admissible heuristic, the first goal found is a closest one. The
+// Greedy heuristic can overestimate, so there the iteration that finds a goal
+// runs to its end and keeps the shortest.
+
+#include "heuristic.h"
+#include "search.h"
+
+#include <algorithm>
+#include <climits>
+#include <new>
+
+namespace {
+
+// Transposition table memory
+constexpr size_t TT_BYTES = 1 << 20;
+
+// search() results besides the next bound
+constexpr int NO_BOUND   = INT_MAX;
+constexpr int TRANSPOSED = INT_MAX - 1; // already searched this iteration, with a smaller g
+
+struct TTEntry {
+    Key key;
+    uint16_t h;         // best known lower bound on the cost to go, kept across iterations
+    uint16_t g;         // smallest g the position was searched with in _iteration_
+    uint16_t iteration;
+    uint16_t used;
+};
+
+/*
+ * Buckets of 4 entries, one cache line each.
+ * A new position takes an empty slot, then one from an older iteration,
+ * then the deepest one (largest g), as those are the cheapest to search again.
+ */
+class TranspositionTable {
+    private:
+    static constexpr int WAYS = 4;
+    TTEntry *table;
+    size_t mask;
+
+    public:
+    explicit TranspositionTable(size_t bytes)
+      : table(nullptr)
+      , mask(0)
+    {
+        size_t buckets = 1;
+        while (buckets * 2 * WAYS * sizeof(TTEntry) <= bytes) {
+            buckets *= 2;
+        }
+        for (; buckets >= 1 && !table; buckets /= 2) {
+            table = new (std::nothrow) TTEntry[buckets * WAYS]();
+            mask  = buckets - 1;
+        }
+    }
+    ~TranspositionTable() { delete[] table; }
+
+    TranspositionTable(const TranspositionTable &)            = delete;
+    TranspositionTable &operator=(const TranspositionTable &) = delete;
+
+    /*
+     * @returns The entry for _key_, nullptr if absent
+     */
+    TTEntry *probe(Key key) const
+    {
+        if (!table) {
+            return nullptr;
+        }
+        TTEntry *bucket = table + (key & mask) * WAYS;
+        for (int i = 0; i < WAYS; i += 1) {
+            if (bucket[i].used && bucket[i].key == key) {
+                return &bucket[i];
+            }
+        }
+        return nullptr;
+    }
+
+    /*
+     * @returns The entry for _key_, claiming a slot for it if absent
+     *          nullptr if there is no table at all
+     */
+    TTEntry *store(Key key, uint16_t h, uint16_t iteration)
+    {
+        if (!table) {
+            return nullptr;
+        }
+        TTEntry *bucket = table + (key & mask) * WAYS;
+        TTEntry *victim = nullptr;
+        for (int i = 0; i < WAYS; i += 1) {
+            TTEntry *e = &bucket[i];
+            if (!e->used) {
+                victim = e;
+                break;
+            }
+            if (e->key == key) {
+                return e;
+            }
+            // Lower is a better victim: older iterations first, then larger g
+            auto worth = [iteration](const TTEntry *t) {
+                return (int(t->iteration == iteration) << 16) + (UINT16_MAX - t->g);
+            };
+            if (!victim || worth(e) < worth(victim)) {
+                victim = e;
+            }
+        }
+        *victim = TTEntry{ key, h, UINT16_MAX, iteration, 1 };
+        return victim;
+    }
+};
+
+class IDAStarSearch {
+    private:
+    Position &pos;
+    const SearchLimits &limits;
+    std::vector<Move> &path;
+    std::vector<Move> best; // shortest solution of this iteration so far, the only one if ADMISSIBLE
+    bool found;
+    TranspositionTable tt;
+    int bound;
+    uint16_t iteration;
+    uint64_t nodes;
+    bool timeout;
+
+    /*
+     * Depth-first search below _bound_.
+     * @param   g       Cost of the current path
+     * @param   h       heuristic() of the current position
+     * @param   cache   Its cache, for the children's
+     * @returns The smallest f that went over the bound. Solutions go to _best_.
+     */
+    int search(int g, int h, const HeuristicCache &cache)
+    {
+        if ((++nodes & 1023) == 0 && limits.expired()) {
+            timeout = true;
+            return NO_BOUND;
+        }
+
+        Key key    = pos.key();
+        TTEntry *e = tt.probe(key);
+        if (e) {
+            if (e->iteration == iteration && e->g <= g) {
+                return TRANSPOSED;
+            }
+            h = std::max<int>(h, e->h);
+        }
+
+        int f = g + h;
+        if (f > bound) {
+            return f;
+        }
+        if (found && g >= int(best.size())) {
+            return NO_BOUND; // cannot beat the solution we have
+        }
+        if (pos.is_hw1_goal()) {
+            best  = path;
+            found = true;
+            return NO_BOUND;
+        }
+
+        e = tt.store(key, h, iteration);
+        if (e) {
+            e->g         = g;
+            e->iteration = iteration;
+        }
+
+        int next   = NO_BOUND;
+        bool exact = true; // false if a child was cut as a transposition
+        MoveList<> moves(pos);
+        for (const Move &mv : moves) {
+            UndoInfo ui;
+            pos.do_move_unchecked(mv, ui);
+            path.push_back(mv);
+            HeuristicCache child;
+            int t = search(g + 1, heuristic_after(pos, cache, mv, child), child);
+            path.pop_back();
+            pos.undo_move(mv, ui);
+
+            if (timeout || (found && ADMISSIBLE)) {
+                return NO_BOUND;
+            }
+            if (t == TRANSPOSED) {
+                exact = false;
+                continue;
+            }
+            next = std::min(next, t);
+        }
+
+        // Every path from here costs at least next - g, remember it for the next iterations
+        if (exact && next != NO_BOUND && (e = tt.probe(key))) {
+            e->h = std::max<int>(e->h, next - g);
+        }
+        return next;
+    }
+
+    public:
+    IDAStarSearch(Position &pos, const SearchLimits &limits, std::vector<Move> &path)
+      : pos(pos)
+      , limits(limits)
+      , path(path)
+      , found(false)
+      , tt(TT_BYTES)
+      , bound(0)
+      , iteration(0)
+      , nodes(0)
+      , timeout(false)
+    {}
+
+    bool run()
+    {
+        HeuristicCache cache;
+        int h = heuristic(pos, cache);
+        bound = h;
+        while (true) {
+            iteration += 1;
+            path.clear();
+            DBG << "IDA* iteration " << iteration << ", bound = " << bound << "\n";
+
+            int t = search(0, h, cache);
+            if (found && !timeout) {
+                path = best;
+                return true;
+            }
+            if (timeout || t == NO_BOUND || t == TRANSPOSED) {
+                return false;
+            }
+            bound = t;
+        }
+    }
+};
+
+} // namespace
+
+bool idastar(Position &root, const SearchLimits &limits, std::vector<Move> &path)
+{
+    IDAStarSearch search(root, limits, path);
+    return search.run();
+}
@@ -18,6 +18,26 @@ extern std::ostream &info;  // **Answers go here!**
 extern std::ostream &error; // This is stderr
 extern std::ostream &debug; // This is also stderr
 
+/*
+ * Log levels. Anything above LOG_LEVEL compiles to nothing, formatting included:
+ *
+ *   DBG << "f_cost = " << f << "\n";
+ *
+ * Set with -DLOG_LEVEL=..., sources.mk adds LOG_DEBUG for `make dbg`.
+ * Answers go to info directly and are never filtered.
+ */
+enum LogLevel { LOG_NONE, LOG_ERROR, LOG_INFO, LOG_DEBUG };
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
+#define LOG(level, stream) \
+    if constexpr ((level) > (LOG_LEVEL)) { \
+    } else \
+        (stream)
+#define DBG LOG(LOG_DEBUG, debug)
+
 /*
  * Pseudo-random number generator provided by PCG.
  * @global
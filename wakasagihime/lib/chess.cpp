@@ -48,6 +48,22 @@ const std::unordered_map<char, Piece> CHAR2PIECE = {
 
 uint8_t SquareDistance[SQUARE_NB][SQUARE_NB];
 
+Key Zobrist::psq[SIDE_NB][REAL_PIECE_TYPE_NB][SQUARE_NB];
+Key Zobrist::side;
+
+void Zobrist::init()
+{
+    pcg64 keygen(0x5EED);
+    for (auto &side_keys : psq) {
+        for (auto &type_keys : side_keys) {
+            for (Key &k : type_keys) {
+                k = keygen();
+            }
+        }
+    }
+    side = keygen();
+}
+
 Board PseudoAttacks[SQUARE_NB];
 
 std::ostream &operator<<(std::ostream &os, const Square &sq)
@@ -184,13 +200,13 @@ void Position::clear()
 {
     memset(byTypeBB, 0, sizeof(byTypeBB));
     memset(byColorBB, 0, sizeof(byColorBB));
-    for (Square sq = SQ_A1; sq < SQUARE_NB; sq += 1) {
-        board[sq] = Piece();
-    }
+    memset(board, 0, sizeof(board));
 
+    info.key            = (sideToMove == Black) ? Zobrist::side : 0;
     info.fiftyMoveCount = 0;
     info.illegal        = NO_COLOR;
-    info.time_remaining = std::pair(0.0, 0.0);
+    info.time_remaining[Black] = 0.0f;
+    info.time_remaining[Red]   = 0.0f;
 }
 
 Board Position::subordinates(Color c, PieceType pt) const
@@ -210,7 +226,8 @@ void Position::place_piece_at(const Piece &p, Square sq)
         remove_piece_at(sq);
     }
 
-    board[sq] = p;
+    board[sq] = pack(p);
+    info.key ^= Zobrist::piece_key(p, sq);
 
     byTypeBB[p.type] |= sq;
     byTypeBB[ALL_PIECES] |= sq;
@@ -224,8 +241,9 @@ void Position::place_piece_at(const Piece &p, Square sq)
 
 Piece Position::remove_piece_at(Square sq)
 {
-    Piece p   = board[sq];
-    board[sq] = Piece();
+    Piece p   = unpack(board[sq]);
+    board[sq] = 0;
+    info.key ^= Zobrist::piece_key(p, sq);
 
     byTypeBB[p.type] ^= sq;
     byTypeBB[ALL_PIECES] ^= sq;
@@ -238,13 +256,30 @@ Piece Position::remove_piece_at(Square sq)
     return p;
 }
 
+Piece Position::draw_from_collection()
+{
+    assert(pieceTotal > 0);
+    // Weighted by how many of each piece are left
+    int r = rng(pieceTotal);
+    for (Color c : { Black, Red }) {
+        for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+            r -= pieceCount[c][pt];
+            if (r < 0) {
+                pieceCount[c][pt] -= 1;
+                pieceTotal -= 1;
+                return Piece(c, pt);
+            }
+        }
+    }
+    return Piece(); // unreachable
+}
+
 bool Position::flip_piece_at(Square sq)
 {
     if (peek_piece_at(sq).side != Mystery) {
         return false;
     }
-    Piece new_piece =
-        pieceCollection.empty() ? random_faceup_piece() : sample_remove(pieceCollection);
+    Piece new_piece = pieceTotal == 0 ? random_faceup_piece() : draw_from_collection();
 
     place_piece_at(new_piece, sq);
     return true;
@@ -255,25 +290,23 @@ void Position::add_collection(Piece *set, size_t n)
     if (set == nullptr) {
         // use default piece set
         for (Color s : { Color::Red, Color::Black }) {
-            // clang-format off
-            pieceCollection
-                << Piece(s, General)
-                << Piece(s, Advisor)  << Piece(s, Advisor)
-                << Piece(s, Elephant) << Piece(s, Elephant)
-                << Piece(s, Chariot)  << Piece(s, Chariot)
-                << Piece(s, Horse)    << Piece(s, Horse)
-                << Piece(s, Cannon)   << Piece(s, Cannon)
-                << Piece(s, Soldier)  << Piece(s, Soldier)
-                << Piece(s, Soldier)  << Piece(s, Soldier)
-                << Piece(s, Soldier);
-            // clang-format on
+            pieceCount[s][General]  += 1;
+            pieceCount[s][Advisor]  += 2;
+            pieceCount[s][Elephant] += 2;
+            pieceCount[s][Chariot]  += 2;
+            pieceCount[s][Horse]    += 2;
+            pieceCount[s][Cannon]   += 2;
+            pieceCount[s][Soldier]  += 5;
+            pieceTotal += 16;
         }
         return;
     }
 
     // Use provided n pieces
     for (int i = 0; i < n; i += 1) {
-        pieceCollection << set[i];
+        assert(set[i].side < SIDE_NB && set[i].type < MOVABLE_PIECE_TYPE_NB);
+        pieceCount[set[i].side][set[i].type] += 1;
+        pieceTotal += 1;
     }
 }
 
@@ -301,7 +334,11 @@ void Position::readFEN(std::string fen)
     Square sq = SQ_A1;
     for (auto token : tokens) {
         if (i == 4) {
-            sideToMove = (token.compare("b") == 0) ? Black : Red;
+            Color side = (token.compare("b") == 0) ? Black : Red;
+            if (side != sideToMove) {
+                info.key ^= Zobrist::side;
+                sideToMove = side;
+            }
             break;
         }
         // parse a rank
@@ -392,6 +429,36 @@ bool Position::do_move(const Move &mv)
     return true;
 }
 
+void Position::do_move_unchecked(const Move &mv, UndoInfo &ui)
+{
+    assert(mv.type() == Moving);
+    Square from = mv.from();
+    Square to   = mv.to();
+
+    ui.captured       = peek_piece_at(to);
+    ui.fiftyMoveCount = info.fiftyMoveCount;
+    ui.key            = info.key;
+
+    // 50-move
+    info.fiftyMoveCount = (ui.captured.side != NO_COLOR) ? 0 : info.fiftyMoveCount + 1;
+
+    place_piece_at(remove_piece_at(from), to);
+}
+
+void Position::undo_move(const Move &mv, const UndoInfo &ui)
+{
+    Square from = mv.from();
+    Square to   = mv.to();
+
+    place_piece_at(remove_piece_at(to), from);
+    if (ui.captured.side != NO_COLOR) {
+        place_piece_at(ui.captured, to);
+    }
+
+    info.fiftyMoveCount = ui.fiftyMoveCount;
+    info.key            = ui.key;
+}
+
 double Position::time_left(Color color) const
 {
     if (color != Red && color != Black) {
@@ -399,26 +466,47 @@ double Position::time_left(Color color) const
     }
     switch (color) {
         case Red:
-            return info.time_remaining.first;
         case Black:
-            return info.time_remaining.second;
+            return info.time_remaining[color];
         default:
             return 0.0;
     }
 }
 
+bool Position::has_any_move(Color c) const
+{
+    assert(c == Red || c == Black);
+
+    if (pieces(Hidden)) {
+        return true; // anyone can flip
+    }
+
+    Board occupied = pieces();
+    for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+        Board bb = pieces(c, pt);
+        if (bb == 0) {
+            continue;
+        }
+        Board target = subordinates(c, pt) | ~occupied;
+        for (Square from : BoardView(bb)) {
+            if (attacks_bb(pt, from, occupied) & target) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 Color Position::winner(WinCon *wc) const
 {
     // HW1 special
 
     // No legal moves for you: bad
-    MoveList<All, Black> moves_b(*this);
-    if (moves_b.size() == 0) {
+    if (!has_any_move(Black)) {
         return Red;
     }
 
-    MoveList<All, Red> moves_r(*this);
-    if (moves_r.size() == 0) {
+    if (!has_any_move(Red)) {
         if (count(Red, ALL_PIECES) == 0) {
             return Black;
         }
@@ -14,7 +14,9 @@
 #include <csignal>
 #include <cstdint>
 #include <cstring>
+#include <functional>
 #include <optional>
+#include <type_traits>
 
 // -~ Colors ~-
 
@@ -178,11 +180,42 @@ struct Piece {
     }
 };
 
+// -~ UndoInfo ~-
+// What undo_move() needs to take back a move made with do_move_unchecked()
+struct UndoInfo {
+    Piece captured;
+    int fiftyMoveCount;
+    Key key;
+};
+
 inline Piece random_faceup_piece()
 {
     return Piece(Color(rng(SIDE_NB)), PieceType(rng(MOVABLE_PIECE_TYPE_NB)));
 }
 
+// -~ Zobrist keys ~-
+namespace Zobrist {
+// Hidden pieces are stored under the Red index, as they are the only ones of type Hidden
+extern Key psq[SIDE_NB][REAL_PIECE_TYPE_NB][SQUARE_NB];
+extern Key side;
+
+/*
+ * Fills the key tables. The seed is fixed so keys are the same on every run.
+ * @internal
+ */
+void init();
+
+/*
+ * Key of a piece standing on a square.
+ * @param   p   The piece, must not be empty
+ * @param   sq  The square
+ */
+inline Key piece_key(const Piece &p, Square sq)
+{
+    return psq[p.side == Mystery ? Red : p.side][p.type][sq];
+}
+} // namespace Zobrist
+
 // -~ Boards ~-
 
 // Attack bitboards for normal pieces (we only have one type in CDC)
@@ -264,14 +297,33 @@ std::istream &operator>>(std::istream &is, Move &mv);
 // -~ Position ~-
 class Position {
     private:
-    // Boards
-    Piece board[SQUARE_NB];
+    // Hot: touched by every move
     Board byTypeBB[PIECE_TYPE_NB];
     Board byColorBB[SIDE_NB];
-    // Data
+    uint8_t board[SQUARE_NB]; // packed, see pack()
     Color sideToMove;
-    std::vector<Piece> pieceCollection;
     StateInfo info;
+    // Cold: the bag of face-down pieces, as counts
+    uint8_t pieceCount[SIDE_NB][MOVABLE_PIECE_TYPE_NB];
+    uint8_t pieceTotal;
+
+    /*
+     * One-byte pieces for the mailbox.
+     * 0 is an empty square, otherwise bits 0 ~ 3 are the type and bits 4 ~ 6 are the side + 1.
+     */
+    static uint8_t pack(const Piece &p)
+    {
+        return p.side == NO_COLOR ? 0 : uint8_t(((p.side + 1) << 4) | p.type);
+    }
+    static Piece unpack(uint8_t code)
+    {
+        return code ? Piece(Color((code >> 4) - 1), PieceType(code & 0xF)) : Piece();
+    }
+
+    /*
+     * Takes a random piece out of a non-empty bag.
+     */
+    Piece draw_from_collection();
 
     public:
     /*
@@ -281,6 +333,7 @@ class Position {
       : sideToMove(Red)
     {
         clear();
+        clear_collection();
     }
 
     /*
@@ -288,6 +341,7 @@ class Position {
      * @param   fen The FEN string
      */
     Position(std::string fen)
+      : sideToMove(Red)
     {
         clear();
         readFEN(fen);
@@ -315,7 +369,35 @@ class Position {
     /*
      * Clears the bag for face-down pieces.
      */
-    void clear_collection() { pieceCollection.clear(); }
+    void clear_collection()
+    {
+        memset(pieceCount, 0, sizeof(pieceCount));
+        pieceTotal = 0;
+    }
+
+    /*
+     * Counts pieces in the bag.
+     * @param   c,pt    The kind of piece. If left empty, counts the whole bag.
+     */
+    int collection_count() const { return pieceTotal; }
+    int collection_count(Color c, PieceType pt) const
+    {
+        assert(c < SIDE_NB && pt < MOVABLE_PIECE_TYPE_NB);
+        return pieceCount[c][pt];
+    }
+
+    /*
+     * Chance that the next flip reveals a piece.
+     * @param   p   The face-up piece
+     * @note    If the bag is empty, every face-up piece is equally likely.
+     */
+    double flip_probability(const Piece &p) const
+    {
+        if (pieceTotal == 0) {
+            return 1.0 / (SIDE_NB * MOVABLE_PIECE_TYPE_NB);
+        }
+        return double(collection_count(p.side, p.type)) / pieceTotal;
+    }
 
     /*
      * Makes a position from a FEN-like string.
@@ -342,11 +424,34 @@ class Position {
      */
     Color winner(WinCon *wc = nullptr) const;
 
+    /*
+     * Whether a side has any legal move, found without listing them all.
+     * @param   c   Red or Black
+     */
+    bool has_any_move(Color c) const;
+
+    /*
+     * HW1 terminal checks, cheaper than winner().
+     * is_hw1_goal()    Black has won: all red pieces are gone and black can still move
+     * is_dead()        The side to play has no legal move
+     */
+    bool is_hw1_goal() const
+    {
+        return count(Red, ALL_PIECES) == 0 && !has_any_move(Red) && has_any_move(Black);
+    }
+    bool is_dead() const { return !has_any_move(sideToMove); }
+
     /*
      * @returns Red/Black   The color to play.
      */
     Color due_up() const { return sideToMove; }
 
+    /*
+     * @returns The Zobrist key of this position, side to play included.
+     * @note    Kept up to date by place_piece_at() and remove_piece_at().
+     */
+    Key key() const { return info.key; }
+
     /*
      * Gets the time remaining.
      * Not available for HW1.
@@ -457,7 +562,7 @@ class Position {
      * @param   sq  The square
      * @returns The piece
      */
-    Piece peek_piece_at(Square sq) const { return board[sq]; }
+    Piece peek_piece_at(Square sq) const { return unpack(board[sq]); }
 
     /*
      * Flips a face-down piece.
@@ -475,8 +580,35 @@ class Position {
      * @return  Whether the move was successful
      */
     bool do_move(const Move &mv);
+
+    /*
+     * Performs a move without validating it.
+     * @param   mv  The move to perform. Must be a legal move, e.g. one from MoveList.
+     * @param   ui  Filled with what undo_move() needs
+     */
+    void do_move_unchecked(const Move &mv, UndoInfo &ui);
+
+    /*
+     * Takes back a move made with do_move_unchecked().
+     * @param   mv  The move that was performed
+     * @param   ui  The record do_move_unchecked() filled
+     */
+    void undo_move(const Move &mv, const UndoInfo &ui);
 };
 
+static_assert(std::is_trivially_copyable<Position>::value, "Positions are copied with memcpy");
+static_assert(sizeof(Position) <= 128, "Positions should fit in two cache lines");
+
 std::ostream &operator<<(std::ostream &os, const Position &pos);
 
+/*
+ * Positions hash to their Zobrist key, so they can be used in std::unordered_* directly.
+ */
+namespace std {
+template<>
+struct hash<Position> {
+    size_t operator()(const Position &pos) const noexcept { return pos.key(); }
+};
+} // namespace std
+
 #endif
\ No newline at end of file
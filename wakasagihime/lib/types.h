@@ -189,12 +189,17 @@ class WinCon {
     Value value;
 };
 
+// -~ Keys ~-
+// Zobrist hash of a position
+using Key = uint64_t;
+
 // -~ StateInfo ~-
 // Records various stats about a position
 struct StateInfo {
+    Key key;
     int fiftyMoveCount;
     Color illegal;
-    std::pair<double, double> time_remaining; // RED, BLACK
+    float time_remaining[SIDE_NB]; // by Color, not used in HW1
 };
 
 class Position;
@@ -0,0 +1,45 @@
+// Chinese Dark Chess: memory budget
+// ----------------------------------
+// The grader runs us under RLIMIT_AS, and going over it kills the process.
+// Solvers that size their tables up front ask here how much room is left,
+// and threads are started here with stacks that leave them that room.
+
+#include "search.h"
+
+#include <cstdio>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Budget when the address space is not limited
+constexpr size_t DEFAULT_BUDGET = 64 << 20;
+// Left alone for the stack, stdio, the move lists and the output
+constexpr size_t RESERVE = 1 << 20;
+
+size_t memory_budget()
+{
+    rlimit rl;
+    if (getrlimit(RLIMIT_AS, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY) {
+        return DEFAULT_BUDGET;
+    }
+    size_t mapped = 0;
+    FILE *statm   = fopen("/proc/self/statm", "r");
+    if (statm) {
+        unsigned long pages;
+        if (fscanf(statm, "%lu", &pages) == 1) {
+            mapped = pages * sysconf(_SC_PAGESIZE);
+        }
+        fclose(statm);
+    }
+    size_t limit = rl.rlim_cur;
+    return limit > mapped + RESERVE ? limit - mapped - RESERVE : 0;
+}
+
+bool start_thread(pthread_t &handle, void *(*entry)(void *), void *arg)
+{
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, THREAD_STACK_BYTES);
+    bool started = pthread_create(&handle, &attr, entry, arg) == 0;
+    pthread_attr_destroy(&attr);
+    return started;
+}
@@ -0,0 +1,112 @@
+// Chinese Dark Chess: node store
+// ----------------------------------
+// Search nodes live in fixed-size chunks, so indices stay valid forever
+// and growing never copies what is already stored.
+
+#ifndef NODESTORE_H
+#define NODESTORE_H
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
+/*
+ * An append-only arena of T with stable 32-bit indices.
+ * Allocation failures are reported to the caller instead of thrown.
+ *
+ * @param   T           Record type, keep it small and trivially copyable
+ * @param   CHUNK_BITS  log2 of the number of records per chunk
+ */
+template<typename T, int CHUNK_BITS = 12>
+class NodeArena {
+    private:
+    static constexpr uint32_t CHUNK_SIZE = 1U << CHUNK_BITS;
+    static constexpr uint32_t CHUNK_MASK = CHUNK_SIZE - 1;
+
+    T **chunks;
+    uint32_t chunkCount;
+    uint32_t chunkCapacity;
+    uint32_t count;
+
+    bool grow()
+    {
+        if (chunkCount == chunkCapacity) {
+            uint32_t capacity = chunkCapacity ? chunkCapacity * 2 : 64;
+            T **table         = new (std::nothrow) T *[capacity];
+            if (!table) {
+                return false;
+            }
+            if (chunks) {
+                memcpy(table, chunks, chunkCount * sizeof(T *));
+                delete[] chunks;
+            }
+            chunks        = table;
+            chunkCapacity = capacity;
+        }
+        T *chunk = new (std::nothrow) T[CHUNK_SIZE];
+        if (!chunk) {
+            return false;
+        }
+        chunks[chunkCount++] = chunk;
+        return true;
+    }
+
+    public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    NodeArena()
+      : chunks(nullptr)
+      , chunkCount(0)
+      , chunkCapacity(0)
+      , count(0)
+    {}
+    ~NodeArena()
+    {
+        for (uint32_t i = 0; i < chunkCount; i += 1) {
+            delete[] chunks[i];
+        }
+        delete[] chunks;
+    }
+
+    NodeArena(const NodeArena &)            = delete;
+    NodeArena &operator=(const NodeArena &) = delete;
+
+    /*
+     * Appends a record.
+     * @param   item    The record
+     * @returns Its index, NONE if out of memory
+     */
+    uint32_t push(const T &item)
+    {
+        if ((count & CHUNK_MASK) == 0 && (count >> CHUNK_BITS) == chunkCount && !grow()) {
+            return NONE;
+        }
+        chunks[count >> CHUNK_BITS][count & CHUNK_MASK] = item;
+        return count++;
+    }
+
+    /*
+     * Drops the last record, e.g. when a parallel arena failed to take its twin.
+     */
+    void pop_back()
+    {
+        assert(count > 0);
+        count -= 1;
+    }
+
+    T &operator[](uint32_t index)
+    {
+        assert(index < count);
+        return chunks[index >> CHUNK_BITS][index & CHUNK_MASK];
+    }
+    const T &operator[](uint32_t index) const
+    {
+        assert(index < count);
+        return chunks[index >> CHUNK_BITS][index & CHUNK_MASK];
+    }
+
+    uint32_t size() const { return count; }
+};
+
+#endif
@@ -0,0 +1,104 @@
+// Chinese Dark Chess: open list
+// ----------------------------------
+// Costs are small integers, so instead of a heap we keep one bucket per (f, h).
+
+#ifndef OPENLIST_H
+#define OPENLIST_H
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+/*
+ * A two-level bucket queue.
+ * Pops the lowest f first, then the lowest h, then the most recently pushed item.
+ * Push and pop are O(1) (amortised over the cost range).
+ *
+ * There is no decrease-key: push the item again with its new cost and skip
+ * the stale copy when it is popped (lazy deletion).
+ */
+template<typename T>
+class BucketQueue {
+    private:
+    struct Level {
+        std::vector<std::vector<T>> byH;
+        size_t count = 0;
+        int minH     = 0;
+    };
+    std::vector<Level> levels;
+    size_t count = 0;
+    int minF     = 0;
+
+    public:
+    /*
+     * Adds an item.
+     * @param   item    The item
+     * @param   f,h     Its costs, must not be negative
+     */
+    void push(const T &item, int f, int h)
+    {
+        assert(f >= 0 && h >= 0);
+        if (f >= static_cast<int>(levels.size())) {
+            levels.resize(f + 1);
+        }
+        Level &l = levels[f];
+        if (h >= static_cast<int>(l.byH.size())) {
+            l.byH.resize(h + 1);
+        }
+        l.byH[h].push_back(item);
+
+        if (l.count++ == 0 || h < l.minH) {
+            l.minH = h;
+        }
+        if (count++ == 0 || f < minF) {
+            minF = f;
+        }
+    }
+
+    /*
+     * Removes the best item.
+     * @returns The item
+     * @note    The queue must not be empty. Read min_f()/min_h() first if you need its costs.
+     */
+    T pop()
+    {
+        assert(count > 0);
+        Level &l  = levels[minF];
+        auto &b   = l.byH[l.minH];
+        T item    = b.back();
+        b.pop_back();
+        count -= 1;
+        l.count -= 1;
+
+        // Move the cursors to the next non-empty bucket
+        if (l.count > 0) {
+            while (l.byH[l.minH].empty()) {
+                l.minH += 1;
+            }
+        } else if (count > 0) {
+            while (levels[minF].count == 0) {
+                minF += 1;
+            }
+        }
+        return item;
+    }
+
+    /*
+     * Costs of the item pop() would return.
+     * @note    The queue must not be empty.
+     */
+    int min_f() const { return minF; }
+    int min_h() const { return levels[minF].minH; }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    void clear()
+    {
+        levels.clear();
+        count = 0;
+        minF  = 0;
+    }
+};
+
+#endif
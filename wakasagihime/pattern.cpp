@@ -0,0 +1,302 @@
+// Chinese Dark Chess: pattern databases
+// ----------------------------------
+// Additive pattern databases. The black piece types are split into groups,
+// and a red piece belongs to a group if every type that can capture it is in
+// that group. Red pieces that no one group covers are left out. A group's
+// table holds, for every placement of its pieces and every set of its red
+// pieces still alive, the exact number of moves its own pieces need to
+// capture them, with the relaxed moves of heuristic.cpp and nothing else on
+// the board. Every real move is made by a piece of at most one group, so the
+// tables add up to a lower bound.
+//
+// The tables are built once per puzzle by backward BFS, one thread per
+// group. Together they take at most a share of the memory budget: red pieces
+// are dropped from the biggest table until they fit.
+
+#include "heuristic.h"
+#include "rank.h"
+#include "search.h"
+
+#include <algorithm>
+#include <new>
+
+namespace {
+
+// Placements grow as 32^pieces, so groups stay small. Types with more pieces
+// than this are in no group, and their moves count for nothing.
+constexpr int MAX_GROUP_PIECES  = 2;
+constexpr int MAX_GROUP_TARGETS = 16;
+constexpr int MAX_GROUPS        = MOVABLE_PIECE_TYPE_NB;
+// The tables get at most 1 / BUDGET_SHARE of the memory budget, the search needs the rest
+constexpr size_t BUDGET_SHARE = 4;
+constexpr uint8_t UNSEEN      = 255;
+constexpr int NO_PATTERN      = 1000;
+
+struct Group {
+    bool member[MOVABLE_PIECE_TYPE_NB];
+    PieceType slotType[MAX_GROUP_PIECES]; // one slot per piece, by type
+    int pieces;
+    Square target[MAX_GROUP_TARGETS];
+    int targets;
+    uint64_t placements;                  // squares^pieces
+    uint8_t *table;                       // moves left, by placement + placements * alive mask
+    size_t size;
+
+    size_t bytes() const { return targets ? size_t(placements) << targets : 0; }
+};
+
+Group groups[MAX_GROUPS];
+int groupCount;
+FreeSquares freeSquares; // of the puzzle the tables were built for
+
+void clear()
+{
+    for (int g = 0; g < groupCount; g += 1) {
+        delete[] groups[g].table;
+    }
+    groupCount = 0;
+}
+
+/*
+ * Splits the black types into groups and hands out the red pieces.
+ */
+void partition(const Position &root)
+{
+    int count[MOVABLE_PIECE_TYPE_NB] = {};
+    for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+        count[pt] = root.count(Black, pt);
+    }
+
+    // Types that share a red piece they can capture end up in one component
+    int component[MOVABLE_PIECE_TYPE_NB];
+    for (int pt = 0; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+        component[pt] = pt;
+    }
+    auto find = [&component](int pt) {
+        while (component[pt] != pt) {
+            pt = component[pt];
+        }
+        return pt;
+    };
+    Board reds = root.pieces(Red) & ~root.pieces(Duck);
+    for (Square r : BoardView(reds)) {
+        int first = -1;
+        for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+            if (count[pt] && pt > root.peek_piece_at(r).type) {
+                if (first < 0) {
+                    first = find(pt);
+                } else {
+                    component[find(pt)] = first;
+                }
+            }
+        }
+    }
+
+    // Pack each component into groups of at most MAX_GROUP_PIECES pieces
+    for (int c = 0; c < MOVABLE_PIECE_TYPE_NB; c += 1) {
+        Group *open = nullptr;
+        for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+            if (!count[pt] || count[pt] > MAX_GROUP_PIECES || find(pt) != c) {
+                continue;
+            }
+            if (!open || open->pieces + count[pt] > MAX_GROUP_PIECES) {
+                open  = &groups[groupCount++];
+                *open = Group{};
+            }
+            open->member[pt] = true;
+            for (int i = 0; i < count[pt]; i += 1) {
+                open->slotType[open->pieces++] = pt;
+            }
+        }
+    }
+
+    for (Square r : BoardView(reds)) {
+        PieceType type = root.peek_piece_at(r).type;
+        for (int g = 0; g < groupCount; g += 1) {
+            Group &group = groups[g];
+            bool covers  = group.targets < MAX_GROUP_TARGETS;
+            bool any     = false;
+            for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+                if (count[pt] && pt > type) {
+                    any    = true;
+                    covers = covers && group.member[pt];
+                }
+            }
+            if (any && covers) {
+                group.target[group.targets++] = r;
+            }
+        }
+    }
+    for (int g = 0; g < groupCount; g += 1) {
+        groups[g].placements = 1;
+        for (int i = 0; i < groups[g].pieces; i += 1) {
+            groups[g].placements *= freeSquares.count;
+        }
+    }
+}
+
+/*
+ * Fills a group's table, layer by layer, from "every red piece captured".
+ */
+void build(Group &group)
+{
+    std::fill(group.table, group.table + group.size, UNSEEN);
+    std::fill(group.table, group.table + group.placements, 0);
+
+    // Squares each slot could capture a target from
+    Board capturedFrom[MAX_GROUP_PIECES][MAX_GROUP_TARGETS] = {};
+    for (int j = 0; j < group.pieces; j += 1) {
+        for (int k = 0; k < group.targets; k += 1) {
+            for (int x = 0; x < SQUARE_NB; x += 1) {
+                if (relaxed_captures(group.slotType[j], Square(x)) & group.target[k]) {
+                    capturedFrom[j][k] |= Square(x);
+                }
+            }
+        }
+    }
+    uint64_t scale[MAX_GROUP_PIECES];
+    for (int j = 0; j < group.pieces; j += 1) {
+        scale[j] = j == 0 ? 1 : scale[j - 1] * freeSquares.count;
+    }
+
+    bool grown = true;
+    for (int depth = 0; grown && depth + 1 < UNSEEN; depth += 1) {
+        grown = false;
+        for (size_t index = 0; index < group.size; index += 1) {
+            if (group.table[index] != depth) {
+                continue;
+            }
+            uint64_t placement = index % group.placements;
+            uint32_t alive     = uint32_t(index / group.placements);
+            for (int j = 0; j < group.pieces; j += 1) {
+                int at      = int(placement / scale[j] % freeSquares.count);
+                size_t away = index - at * scale[j];
+                Square sq   = freeSquares.square[at];
+                // The piece came here with a plain move, moves are symmetric
+                for (Square x : BoardView(relaxed_moves(group.slotType[j], sq))) {
+                    uint8_t &before = group.table[away + freeSquares.index[x] * scale[j]];
+                    if (before == UNSEEN) {
+                        before = uint8_t(depth + 1);
+                        grown  = true;
+                    }
+                }
+                // Or it captured the red piece it stands on
+                for (int k = 0; k < group.targets; k += 1) {
+                    if (group.target[k] != sq || (alive >> k & 1)) {
+                        continue;
+                    }
+                    for (Square x : BoardView(capturedFrom[j][k])) {
+                        uint8_t &before =
+                            group.table[away + freeSquares.index[x] * scale[j] + (group.placements << k)];
+                        if (before == UNSEEN) {
+                            before = uint8_t(depth + 1);
+                            grown  = true;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void *entry(void *arg)
+{
+    build(*static_cast<Group *>(arg));
+    return nullptr;
+}
+
+} // namespace
+
+void pattern_init(const Position &root)
+{
+    clear();
+    freeSquares = FreeSquares(root.pieces(Duck));
+    partition(root);
+
+    // Drop red pieces from the biggest table until they all fit
+    size_t cap = memory_budget() / BUDGET_SHARE;
+    while (true) {
+        size_t total   = 0;
+        Group *biggest  = nullptr;
+        for (int g = 0; g < groupCount; g += 1) {
+            total += groups[g].bytes();
+            if (!biggest || groups[g].bytes() > biggest->bytes()) {
+                biggest = &groups[g];
+            }
+        }
+        if (total <= cap || !biggest) {
+            break;
+        }
+        biggest->targets -= 1;
+    }
+    for (int g = 0; g < groupCount; g += 1) {
+        Group &group = groups[g];
+        group.size   = group.bytes();
+        group.table  = group.size ? new (std::nothrow) uint8_t[group.size] : nullptr;
+        if (!group.table) {
+            group.size = 0;
+        }
+    }
+
+    // One thread per table, the calling thread takes the first
+    pthread_t handles[MAX_GROUPS];
+    bool started[MAX_GROUPS] = {};
+    int first                = -1;
+    for (int g = 0; g < groupCount; g += 1) {
+        if (!groups[g].table) {
+            continue;
+        }
+        if (first < 0) {
+            first = g;
+            continue;
+        }
+        started[g] = start_thread(handles[g], entry, &groups[g]);
+        if (!started[g]) {
+            build(groups[g]);
+        }
+    }
+    if (first >= 0) {
+        build(groups[first]);
+    }
+    for (int g = 0; g < groupCount; g += 1) {
+        if (started[g]) {
+            pthread_join(handles[g], nullptr);
+        }
+    }
+    for (int g = 0; g < groupCount; g += 1) {
+        DBG << "Pattern database " << g << ": " << groups[g].pieces << " pieces, " << groups[g].targets
+            << " red pieces, " << groups[g].size << " bytes\n";
+    }
+}
+
+int pattern_heuristic(const Position &pos)
+{
+    int sum = 0;
+    for (int g = 0; g < groupCount; g += 1) {
+        const Group &group = groups[g];
+        if (!group.table) {
+            continue;
+        }
+        uint64_t index = 0, scale = 1;
+        for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+            if (!group.member[pt]) {
+                continue;
+            }
+            for (Square sq : BoardView(pos.pieces(Black, pt))) {
+                index += freeSquares.index[sq] * scale;
+                scale *= freeSquares.count;
+            }
+        }
+        for (int k = 0; k < group.targets; k += 1) {
+            if (pos.pieces(Red) & group.target[k]) {
+                index += group.placements << k;
+            }
+        }
+        int moves = group.table[index];
+        if (moves == UNSEEN) {
+            return NO_PATTERN;
+        }
+        sum += moves;
+    }
+    return std::min(sum, NO_PATTERN);
+}
@@ -0,0 +1,185 @@
+// Chinese Dark Chess: portfolio
+// ----------------------------------
+// Runs several solving modes at once, each on its own thread and its own copy
+// of the puzzle. They share the deadline and a cancel flag. The first answer
+// from a mode that is as good as A* wins and stops the others. Answers from
+// the other modes are only kept in case no such answer comes.
+//
+// Debug builds append one line per mode to STATS_FILE, so the mix can be tuned.
+
+#include "search.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+namespace {
+
+// Memory one mode needs: a closed table, its nodes and a stack
+constexpr size_t STRATEGY_BYTES = 2 << 20;
+// Win/loss statistics, one line per mode and puzzle, written by debug builds only
+constexpr const char *STATS_FILE = "portfolio.csv";
+
+using Solver = bool (*)(Position &, const SearchLimits &, std::vector<Move> &);
+
+struct Strategy {
+    const char *name;
+    Solver solve;
+    bool optimal; // answers are as short as the ones astar() finds
+};
+
+bool astar_low_h(Position &root, const SearchLimits &limits, std::vector<Move> &path)
+{
+    return astar(root, limits, path);
+}
+
+bool astar_high_h(Position &root, const SearchLimits &limits, std::vector<Move> &path)
+{
+    AStarOptions options;
+    options.high_h_first = true;
+    return astar(root, limits, path, options);
+}
+
+// In order of preference. When memory is short, only the first few run.
+const Strategy STRATEGIES[] = {
+    { "astar", astar_low_h, true },
+    { "idastar", idastar, true },
+    { "astar-high-h", astar_high_h, true },
+    { "anytime", anytime, false },
+};
+constexpr int STRATEGY_NB = sizeof(STRATEGIES) / sizeof(STRATEGIES[0]);
+
+class PortfolioSearch;
+
+struct Run {
+    PortfolioSearch *portfolio;
+    const Strategy *strategy;
+    Position pos; // searches make moves on it, so every run has its own
+    std::vector<Move> path;
+    bool started;
+    bool solved;
+    double ms;
+};
+
+class PortfolioSearch {
+    private:
+    Position &root;
+    SearchLimits limits; // the caller's, plus our cancel flag
+    std::atomic<bool> cancel{ false };
+    std::mutex lock;
+    Run runs[STRATEGY_NB];
+    int count;
+    int winner;
+
+    void solve(Run &run)
+    {
+        Clock::time_point start = Clock::now();
+        run.solved              = run.strategy->solve(run.pos, limits, run.path);
+        run.ms                  = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (run.solved && run.strategy->optimal) {
+            std::lock_guard<std::mutex> guard(lock);
+            if (winner < 0) {
+                winner = int(&run - runs);
+                cancel = true;
+            }
+        }
+    }
+
+    static void *entry(void *arg)
+    {
+        Run *run = static_cast<Run *>(arg);
+        run->portfolio->solve(*run);
+        return nullptr;
+    }
+
+    /*
+     * Writes how each mode did to the debug stream and to STATS_FILE.
+     */
+    void record(int chosen) const
+    {
+        FILE *stats = fopen(STATS_FILE, "a");
+        if (stats && ftell(stats) == 0) {
+            fprintf(stats, "puzzle,strategy,started,solved,moves,ms,won\n");
+        }
+        for (int i = 0; i < count; i += 1) {
+            const Run &run = runs[i];
+            int moves      = run.solved ? int(run.path.size()) : -1;
+            DBG << "Portfolio: " << run.strategy->name << (i == chosen ? " won" : "") << ", "
+                << (run.started ? "" : "not started, ") << (run.solved ? "solved" : "unsolved") << ", " << moves
+                << " moves, " << run.ms << " ms\n";
+            if (stats) {
+                fprintf(stats, "%016llx,%s,%d,%d,%d,%.3f,%d\n", (unsigned long long)root.key(), run.strategy->name,
+                        run.started, run.solved, moves, run.ms, i == chosen);
+            }
+        }
+        if (stats) {
+            fclose(stats);
+        }
+    }
+
+    public:
+    PortfolioSearch(Position &root, const SearchLimits &outer)
+      : root(root)
+      , limits(outer)
+      , runs{}
+      , count(0)
+      , winner(-1)
+    {
+        limits.cancel = &cancel;
+    }
+
+    PortfolioSearch(const PortfolioSearch &)            = delete;
+    PortfolioSearch &operator=(const PortfolioSearch &) = delete;
+
+    bool run(std::vector<Move> &path)
+    {
+        // The modes run side by side, so each sizes its tables from an equal share
+        size_t budget = memory_budget();
+        count         = std::clamp<int>(budget / STRATEGY_BYTES, 1, STRATEGY_NB);
+        limits.memory = budget / count;
+        for (int i = 0; i < count; i += 1) {
+            runs[i] = Run{ this, &STRATEGIES[i], root, {}, false, false, 0 };
+        }
+
+        // The first mode runs on the calling thread, the others get their own
+        pthread_t handles[STRATEGY_NB];
+        for (int i = 1; i < count; i += 1) {
+            runs[i].started = start_thread(handles[i], entry, &runs[i]);
+        }
+        runs[0].started = true;
+        solve(runs[0]);
+        for (int i = 1; i < count; i += 1) {
+            if (runs[i].started) {
+                pthread_join(handles[i], nullptr);
+            }
+        }
+
+        // Fall back to the shortest answer if no mode could vouch for its own
+        int chosen = winner;
+        if (chosen < 0) {
+            for (int i = 0; i < count; i += 1) {
+                if (runs[i].solved && (chosen < 0 || runs[i].path.size() < runs[chosen].path.size())) {
+                    chosen = i;
+                }
+            }
+        }
+        if (LOG_LEVEL >= LOG_DEBUG) {
+            record(chosen);
+        }
+        if (chosen < 0) {
+            return false;
+        }
+        path = runs[chosen].path;
+        return true;
+    }
+};
+
+} // namespace
+
+bool portfolio(Position &root, const SearchLimits &limits, std::vector<Move> &path)
+{
+    PortfolioSearch search(root, limits);
+    return search.run(path);
+}
@@ -0,0 +1,121 @@
+// Chinese Dark Chess: state ranking
+// ----------------------------------
+
+#include "rank.h"
+
+static inline uint64_t saturating_mul(uint64_t a, uint64_t b)
+{
+    uint64_t p;
+    return __builtin_mul_overflow(a, b, &p) ? UINT64_MAX : p;
+}
+
+FreeSquares::FreeSquares(Board ducks)
+  : count(0)
+{
+    for (int sq = 0; sq < SQUARE_NB; sq += 1) {
+        if (ducks & Square(sq)) {
+            index[sq] = -1;
+            continue;
+        }
+        index[sq]     = count;
+        square[count] = Square(sq);
+        count += 1;
+    }
+}
+
+StateIndexer::StateIndexer(const StateCodec &codec, const Position &root)
+  : codec(codec)
+  , freeSquares(root.pieces(Duck))
+  , groupCount(0)
+{
+    for (int i = 0; i < codec.black_count(); i += 1) {
+        if (i == 0 || codec.black_type(i) != codec.black_type(i - 1)) {
+            groupStart[groupCount++] = i;
+        }
+    }
+    groupStart[groupCount] = codec.black_count();
+
+    for (int n = 0; n <= SQUARE_NB; n += 1) {
+        for (int k = 0; k <= MAX_SLOTS; k += 1) {
+            if (k == 0 || k == n) {
+                binom[n][k] = 1;
+            } else if (k > n) {
+                binom[n][k] = 0;
+            } else {
+                uint64_t sum = binom[n - 1][k - 1] + binom[n - 1][k];
+                binom[n][k]  = sum < binom[n - 1][k] ? UINT64_MAX : sum;
+            }
+        }
+    }
+
+    count    = uint64_t(1) << codec.red_count();
+    int room = freeSquares.count;
+    for (int k = 0; k < groupCount; k += 1) {
+        int pieces = groupStart[k + 1] - groupStart[k];
+        count      = saturating_mul(count, binom[room][pieces]);
+        room -= pieces;
+    }
+}
+
+uint64_t StateIndexer::rank(const State &s) const
+{
+    uint64_t index = s.lo & ((uint64_t(1) << codec.red_count()) - 1);
+    uint64_t scale = uint64_t(1) << codec.red_count();
+    uint32_t used  = 0; // free square indices taken by earlier types
+    int room       = freeSquares.count;
+    for (int k = 0; k < groupCount; k += 1) {
+        uint64_t r    = 0;
+        uint32_t mine = 0;
+        for (int i = groupStart[k]; i < groupStart[k + 1]; i += 1) {
+            int a = freeSquares.index[codec.black_square(s, i)];
+            // Place among the squares still free, C(place, j) for the j-th piece
+            int place = a - __builtin_popcount(used & ((uint32_t(1) << a) - 1));
+            r += binom[place][i - groupStart[k] + 1];
+            mine |= uint32_t(1) << a;
+        }
+        int pieces = groupStart[k + 1] - groupStart[k];
+        index += scale * r;
+        scale *= binom[room][pieces];
+        room -= pieces;
+        used |= mine;
+    }
+    return index;
+}
+
+State StateIndexer::unrank(uint64_t index) const
+{
+    uint32_t redAlive = uint32_t(index & ((uint64_t(1) << codec.red_count()) - 1));
+    index >>= codec.red_count();
+
+    Square squares[MAX_SLOTS];
+    uint32_t used = 0;
+    int room      = freeSquares.count;
+    for (int k = 0; k < groupCount; k += 1) {
+        int pieces = groupStart[k + 1] - groupStart[k];
+        uint64_t r = index % binom[room][pieces];
+        index /= binom[room][pieces];
+
+        uint32_t mine = 0;
+        int place     = room;
+        for (int j = pieces; j > 0; j -= 1) {
+            // Largest place with C(place, j) <= r
+            do {
+                place -= 1;
+            } while (binom[place][j] > r);
+            r -= binom[place][j];
+
+            // The place-th free square not taken by an earlier type
+            int a = 0;
+            for (int left = place; left > 0 || (used >> a) & 1; a += 1) {
+                if (!((used >> a) & 1)) {
+                    left -= 1;
+                }
+            }
+            squares[groupStart[k] + j - 1] = freeSquares.square[a];
+            mine |= uint32_t(1) << a;
+        }
+        room -= pieces;
+        used |= mine;
+    }
+    return codec.compose(redAlive, squares);
+}
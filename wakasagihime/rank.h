@@ -0,0 +1,72 @@
+// Chinese Dark Chess: state ranking
+// ----------------------------------
+// Numbers the states of a puzzle 0, 1, 2, ... with no gaps, so that a set of
+// states can be a plain bitset.
+//
+// The black pieces of one type sit on a combination of the squares without a
+// duck, numbered in the combinatorial number system. Each type is numbered
+// among the squares the types before it left free, and the red-alive mask
+// takes the lowest bits. Some numbers are states no game can reach (a black
+// piece on a live red piece, say), which is the price of a simple formula.
+
+#ifndef RANK_H
+#define RANK_H
+
+#include "state.h"
+
+#include <cstdint>
+
+/*
+ * The squares without a duck, numbered 0, 1, 2, ... in square order.
+ */
+struct FreeSquares {
+    Square square[SQUARE_NB]; // by number
+    int8_t index[SQUARE_NB];  // by square, -1 for a duck
+    int count;
+
+    explicit FreeSquares(Board ducks = 0);
+};
+
+class StateIndexer {
+    private:
+    const StateCodec &codec;
+    FreeSquares freeSquares;
+    // Black slots [groupStart[k], groupStart[k + 1]) share a type
+    int groupStart[MAX_SLOTS + 1];
+    int groupCount;
+    // Binomial coefficients, saturated at UINT64_MAX
+    uint64_t binom[SQUARE_NB + 1][MAX_SLOTS + 1];
+    uint64_t count;
+
+    public:
+    // size() of a puzzle with more states than fit in 64 bits
+    static constexpr uint64_t TOO_MANY = UINT64_MAX;
+
+    /*
+     * Builds an indexer for a puzzle.
+     * @param   codec   The codec of the puzzle, must outlive the indexer
+     * @param   root    The initial puzzle, for where the ducks are
+     */
+    StateIndexer(const StateCodec &codec, const Position &root);
+
+    /*
+     * @returns How many numbers there are, TOO_MANY if they do not fit 64 bits
+     */
+    uint64_t size() const { return count; }
+
+    /*
+     * Numbers a state.
+     * @param   s   A state from the codec
+     * @returns Its number, below size()
+     */
+    uint64_t rank(const State &s) const;
+
+    /*
+     * The state with a given number.
+     * @param   index   Below size()
+     * @returns The state
+     */
+    State unrank(uint64_t index) const;
+};
+
+#endif
@@ -0,0 +1,118 @@
+// Chinese Dark Chess: search
+// ----------------------------------
+// What every solving mode shares. resolve() picks one with SOLVER (see sources.mk).
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "lib/chess.h"
+#include "lib/types.h"
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <pthread.h>
+#include <vector>
+
+// Solving modes
+enum SolverMode {
+    AStar,      // best-first, keeps every node
+    IDAStar,    // iterative deepening, constant memory
+    Anytime,    // weighted A* with shrinking weights, best answer so far at the deadline
+    Frontier,   // breadth-first, keeps three layers and rebuilds the path by divide and conquer
+    External,   // A* with the nodes in sorted files on disk, for offline runs on huge puzzles
+    SMAStar,    // A* that drops its worst leaves to stay within the address space limit
+    PEAStar,    // A* that stores only the children it is about to need
+    Lookahead,  // A* that crosses plateaus with a short depth-first search
+    HDAStar,    // parallel A*, positions shared out between the threads by hash
+    Portfolio,  // several of the above racing on their own threads
+    Exhaustive, // breadth-first over every state, one bit each, for puzzles with few pieces
+};
+
+#ifndef SOLVER
+#define SOLVER AStar
+#endif
+
+// The grader stops waiting after 10 seconds
+constexpr int TIME_LIMIT_MS = 10000;
+
+using Clock = std::chrono::high_resolution_clock;
+
+/*
+ * Bytes the process can still map: the RLIMIT_AS soft limit minus what is
+ * mapped already, minus a reserve for the stack, stdio and the output.
+ * A fixed default when the address space is not limited.
+ */
+size_t memory_budget();
+
+// Stack of every extra thread, small so that many of them fit under RLIMIT_AS
+constexpr size_t THREAD_STACK_BYTES = 256 << 10;
+
+/*
+ * Starts a thread with a THREAD_STACK_BYTES stack.
+ * @param   handle  Set to the thread, for pthread_join()
+ * @returns false if it could not be started
+ */
+bool start_thread(pthread_t &handle, void *(*entry)(void *), void *arg);
+
+/*
+ * When a search has to give up: at the deadline, or as soon as *cancel is set.
+ * Searches that size their tables up front take memory_limit() bytes at most.
+ */
+struct SearchLimits {
+    Clock::time_point deadline;
+    const std::atomic<bool> *cancel = nullptr;
+    size_t memory                   = 0; // 0 for the whole memory_budget()
+
+    bool expired() const
+    {
+        return (cancel && cancel->load(std::memory_order_relaxed)) || Clock::now() > deadline;
+    }
+    size_t memory_limit() const { return memory ? memory : memory_budget(); }
+};
+
+/*
+ * Knobs for astar().
+ * Nodes are ordered by g + weight * h, with weight = weight_num / weight_den.
+ * Children with g + h >= cost_bound are not stored, as they cannot beat a known solution.
+ * With partial_expansion, a node only stores the children that share its priority
+ * and goes back to the open list with the next one (PEA*).
+ * With lookahead_depth > 0, each stored child is first searched depth-first in place,
+ * up to its parent's f + lookahead_margin and at most lookahead_depth moves deep,
+ * and enters the open list with the f found past that (AL*).
+ * Ties on priority go to the lowest h, or to the lowest g with high_h_first.
+ * A search that fills its closed table gives up, and sets *out_of_memory if given.
+ */
+struct AStarOptions {
+    int weight_num         = 1;
+    int weight_den         = 1;
+    int cost_bound         = INT_MAX;
+    bool partial_expansion = false;
+    int lookahead_margin   = 0;
+    int lookahead_depth    = 0;
+    bool high_h_first      = false;
+    bool *out_of_memory    = nullptr;
+};
+
+/*
+ * Solving modes.
+ * @param   root    The puzzle, black to play. Left as it was on return.
+ * @param   limits  When to give up
+ * @param   path    Filled with the moves from _root_ to a goal
+ * @returns Whether a solution was found
+ */
+bool astar(
+    Position &root, const SearchLimits &limits, std::vector<Move> &path,
+    const AStarOptions &options = AStarOptions()
+);
+bool idastar(Position &root, const SearchLimits &limits, std::vector<Move> &path);
+bool anytime(Position &root, const SearchLimits &limits, std::vector<Move> &path);
+bool frontier(Position &root, const SearchLimits &limits, std::vector<Move> &path);
+bool external(Position &root, const SearchLimits &limits, std::vector<Move> &path);
+bool smastar(Position &root, const SearchLimits &limits, std::vector<Move> &path);
+bool hdastar(Position &root, const SearchLimits &limits, std::vector<Move> &path);
+bool portfolio(Position &root, const SearchLimits &limits, std::vector<Move> &path);
+bool exhaustive(Position &root, const SearchLimits &limits, std::vector<Move> &path);
+
+#endif
@@ -0,0 +1,350 @@
+// Chinese Dark Chess: SMA*
+// ----------------------------------
+// Simplified memory-bounded A*. The node pool is sized once from what the
+// address space limit still allows, so the search never allocates after it
+// starts. When the pool is full, the worst leaf is dropped and its f is
+// remembered by its parent. A parent that has lost all its children becomes
+// a leaf again, with that f, and regrows them if it ever looks best.
+//
+// A position reached again in fewer moves moves to its new parent with its
+// whole subtree. Every g and f in that subtree drops by the moves saved.
+
+#include "closedtable.h"
+#include "heuristic.h"
+#include "search.h"
+#include "state.h"
+
+#include <algorithm>
+#include <new>
+
+namespace {
+
+// f above this shares the last bucket
+constexpr int MAX_F = 2048;
+
+constexpr uint32_t NIL  = UINT32_MAX;
+constexpr uint16_t NO_F = UINT16_MAX;
+
+struct SmaNode {
+    Key key;
+    State state;
+    uint32_t parent;
+    uint32_t child;      // first child in memory
+    uint32_t sibling;    // next child of the same parent
+    uint32_t prev, next; // open bucket links, next also links the free list
+    Move mv;             // from the parent
+    uint16_t g;
+    uint16_t f;          // backed up from dropped children once it has lost them all
+    uint16_t forgotten;  // smallest f among the dropped children, NO_F if none
+    uint16_t children;   // children in memory
+    uint8_t inOpen;
+    uint8_t regrown;     // f was backed up, its children may not be any cheaper
+};
+
+class SMAStarSearch {
+    private:
+    Position &root;
+    const SearchLimits &limits;
+    StateCodec codec;
+    ClosedTable table; // positions in memory, to their nodes
+    SmaNode *pool;
+    uint32_t capacity;
+    uint32_t used; // high-water mark of the pool
+    uint32_t freeList;
+
+    // Leaves by f. New leaves go to the head, so the best one is the newest
+    // of the lowest bucket and the worst one the oldest of the highest.
+    uint32_t head[MAX_F], tail[MAX_F];
+    int minF, maxF;
+
+    uint32_t allocate()
+    {
+        if (freeList != NIL) {
+            uint32_t i = freeList;
+            freeList   = pool[i].next;
+            return i;
+        }
+        return used < capacity ? used++ : NIL;
+    }
+
+    void link(uint32_t i, uint32_t parent)
+    {
+        pool[i].parent     = parent;
+        pool[i].sibling    = pool[parent].child;
+        pool[parent].child = i;
+    }
+
+    void unlink(uint32_t i)
+    {
+        uint32_t *at = &pool[pool[i].parent].child;
+        while (*at != i) {
+            at = &pool[*at].sibling;
+        }
+        *at = pool[i].sibling;
+    }
+
+    void release(uint32_t i)
+    {
+        if (pool[i].parent != NIL) {
+            unlink(i);
+        }
+        table.erase(table.find(pool[i].key));
+        pool[i].next = freeList;
+        freeList     = i;
+    }
+
+    void open_push(uint32_t i)
+    {
+        SmaNode &n = pool[i];
+        int f      = std::min<int>(n.f, MAX_F - 1);
+        n.prev     = NIL;
+        n.next     = head[f];
+        if (head[f] != NIL) {
+            pool[head[f]].prev = i;
+        } else {
+            tail[f] = i;
+        }
+        head[f]  = i;
+        n.inOpen = 1;
+        minF     = std::min(minF, f);
+        maxF     = std::max(maxF, f);
+    }
+
+    void open_remove(uint32_t i)
+    {
+        SmaNode &n = pool[i];
+        int f      = std::min<int>(n.f, MAX_F - 1);
+        (n.prev != NIL ? pool[n.prev].next : head[f]) = n.next;
+        (n.next != NIL ? pool[n.next].prev : tail[f]) = n.prev;
+        n.inOpen = 0;
+    }
+
+    uint32_t open_best()
+    {
+        while (minF < MAX_F && head[minF] == NIL) {
+            minF += 1;
+        }
+        return minF < MAX_F ? head[minF] : NIL;
+    }
+
+    uint32_t open_worst()
+    {
+        while (maxF >= 0 && tail[maxF] == NIL) {
+            maxF -= 1;
+        }
+        return maxF >= 0 ? tail[maxF] : NIL;
+    }
+
+    /*
+     * Called when node _q_ loses a child. Once it has none left, it becomes
+     * a leaf again if it remembers a dropped child, and goes away otherwise.
+     */
+    void lose_child(uint32_t q)
+    {
+        while (--pool[q].children == 0) {
+            SmaNode &n = pool[q];
+            if (n.forgotten != NO_F) {
+                n.f         = std::max(n.f, n.forgotten);
+                n.forgotten = NO_F;
+                n.regrown   = 1;
+                open_push(q);
+                return;
+            }
+            if (n.parent == NIL) {
+                return; // the root, nothing is left below it
+            }
+            uint32_t p = n.parent;
+            release(q);
+            q = p;
+        }
+    }
+
+    /*
+     * Drops leaf _w_ and backs its f up into its parent.
+     */
+    void prune(uint32_t w)
+    {
+        open_remove(w);
+        uint32_t q = pool[w].parent;
+        uint16_t f = pool[w].f;
+        release(w);
+        pool[q].forgotten = std::min(pool[q].forgotten, f);
+        lose_child(q);
+    }
+
+    /*
+     * Takes _delta_ off the costs of node _i_, keeping f at least _floor_.
+     * Its bounds were worked out along a path _delta_ moves longer, and the
+     * rest of the way is unchanged.
+     */
+    void shift(uint32_t i, int delta, int floor = 0)
+    {
+        SmaNode &n = pool[i];
+        bool leaf  = n.inOpen;
+        if (leaf) {
+            open_remove(i);
+        }
+        n.g -= delta;
+        n.f = std::max(n.f - delta, floor);
+        if (n.forgotten != NO_F) {
+            n.forgotten -= delta;
+        }
+        if (leaf) {
+            open_push(i);
+        }
+    }
+
+    /*
+     * Moves node _e_ and its subtree under _cur_, which reaches it in fewer
+     * moves. Its own f is also at least _f_.
+     */
+    void reparent(uint32_t e, uint32_t cur, const Move &mv, int g, int f)
+    {
+        uint32_t old = pool[e].parent;
+        int delta    = pool[e].g - g;
+        unlink(e);
+        link(e, cur);
+        pool[e].mv = mv;
+        shift(e, delta, f);
+        // The subtree in preorder, over the child and sibling links
+        uint32_t i = pool[e].child;
+        while (i != NIL) {
+            shift(i, delta);
+            if (pool[i].child != NIL) {
+                i = pool[i].child;
+                continue;
+            }
+            while (i != e && pool[i].sibling == NIL) {
+                i = pool[i].parent;
+            }
+            i = i == e ? NIL : pool[i].sibling;
+        }
+        pool[cur].children += 1;
+        lose_child(old);
+    }
+
+    public:
+    SMAStarSearch(Position &root, const SearchLimits &limits, size_t budget)
+      : root(root)
+      , limits(limits)
+      , codec(root)
+      , table(budget / (sizeof(SmaNode) + 2 * sizeof(ClosedTable::Entry)) * 2 * sizeof(ClosedTable::Entry))
+      , pool(nullptr)
+      , capacity(0)
+      , used(0)
+      , freeList(NIL)
+      , minF(MAX_F)
+      , maxF(-1)
+    {
+        std::fill(head, head + MAX_F, NIL);
+        std::fill(tail, tail + MAX_F, NIL);
+        size_t nodes = std::min(budget / (sizeof(SmaNode) + 2 * sizeof(ClosedTable::Entry)), table.capacity());
+        for (; nodes > 0 && !pool; nodes /= 2) {
+            pool     = new (std::nothrow) SmaNode[nodes];
+            capacity = pool ? nodes : 0;
+        }
+    }
+    ~SMAStarSearch() { delete[] pool; }
+
+    SMAStarSearch(const SMAStarSearch &)            = delete;
+    SMAStarSearch &operator=(const SMAStarSearch &) = delete;
+
+    bool run(std::vector<Move> &path)
+    {
+        DBG << "SMA*: room for " << capacity << " nodes\n";
+        uint32_t r                = allocate();
+        ClosedTable::Entry *entry = table.insert(root.key());
+        if (r == NIL || !entry) {
+            return false;
+        }
+        entry->index = r;
+        pool[r]      = SmaNode{ root.key(), codec.encode(root), NIL, NIL, NIL, NIL, NIL, Move(), 0,
+                                uint16_t(heuristic(root)), NO_F, 0, 0, 0 };
+        open_push(r);
+
+        Position pos;
+        uint32_t cur;
+        while ((cur = open_best()) != NIL) {
+            if (limits.expired()) {
+                return false;
+            }
+            open_remove(cur);
+            codec.decode(pool[cur].state, pos);
+            if (pos.is_hw1_goal()) {
+                path.clear();
+                for (; pool[cur].parent != NIL; cur = pool[cur].parent) {
+                    path.push_back(pool[cur].mv);
+                }
+                std::reverse(path.begin(), path.end());
+                return true;
+            }
+
+            // Pinned by one extra child while its children are added,
+            // so pruning them cannot turn it back into a leaf halfway
+            pool[cur].children += 1;
+            pool[cur].forgotten = NO_F;
+            int g               = pool[cur].g + 1;
+            HeuristicCache cache, child;
+            heuristic(pos, cache);
+            MoveList<> moves(pos);
+            for (const Move &mv : moves) {
+                UndoInfo ui;
+                pos.do_move_unchecked(mv, ui);
+                Key key     = pos.key();
+                State state = codec.encode(pos);
+                int f       = std::min<int>(g + heuristic_after(pos, cache, mv, child), NO_F - 1);
+                pos.undo_move(mv, ui);
+                // The heuristic is not consistent, so f only inherits the
+                // parent's f when that was backed up from dropped children
+                if (pool[cur].regrown) {
+                    f = std::max<int>(f, pool[cur].f);
+                }
+
+                ClosedTable::Entry *seen = table.find(key);
+                if (seen) {
+                    uint32_t e = seen->index;
+                    if (g < pool[e].g) {
+                        reparent(e, cur, mv, g, f);
+                    }
+                    continue;
+                }
+
+                // Make room by dropping a leaf, unless they are all better than the new child.
+                // On a tie the new one stays: it is deeper, and the search would stall on one f otherwise.
+                uint32_t i = allocate();
+                while (i == NIL) {
+                    uint32_t w = open_worst();
+                    if (w == NIL || pool[w].f < f) {
+                        break;
+                    }
+                    prune(w);
+                    i = allocate();
+                }
+                if (i != NIL && !(entry = table.insert(key))) {
+                    pool[i].next = freeList;
+                    freeList     = i;
+                    i            = NIL;
+                }
+                if (i == NIL) {
+                    pool[cur].forgotten = std::min<uint16_t>(pool[cur].forgotten, f);
+                    continue;
+                }
+                entry->index = i;
+                pool[i]      = SmaNode{ key, state, NIL, NIL, NIL, NIL, NIL, mv, uint16_t(g), uint16_t(f), NO_F, 0, 0, 0 };
+                link(i, cur);
+                pool[cur].children += 1;
+                open_push(i);
+            }
+            lose_child(cur); // unpin
+        }
+        return false;
+    }
+};
+
+} // namespace
+
+bool smastar(Position &root, const SearchLimits &limits, std::vector<Move> &path)
+{
+    SMAStarSearch search(root, limits, memory_budget());
+    return search.run(path);
+}
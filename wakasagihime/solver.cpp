@@ -1,7 +1,11 @@
 #include "solver.h"
 #include "lib/helper.h"
-#include <queue>
-#include <unordered_map>
+#include "closedtable.h"
+#include "heuristic.h"
+#include "nodestore.h"
+#include "openlist.h"
+#include "search.h"
+#include "state.h"
 #include <vector>
 #include <algorithm>
 #include <chrono>
@@ -20,161 +24,282 @@
  * Good luck!
  */
 
-struct Node{
-    std::string pos_str;
-    int g_cost;// actual cost from start to current state
-    int h_cost;// heuristic cost to reach the goal
-    int f_cost;// g + h, can be omitted actually (?)
+// how far past a node's f the Lookahead mode searches from each of its children, 0 walks its plateau only
+constexpr int LOOKAHEAD_MARGIN = 0;
+// how many moves deep it goes at most, enough to walk across a plateau of quiet moves
+constexpr int LOOKAHEAD_DEPTH = 8;
 
-    int parent;// index of parent
+// node records are kept small, the packed state of node i is states[i]
+struct Node{
+    uint32_t parent;// index of parent
     Move mv;// move from parent to current
+    uint16_t g_cost;// actual cost from start to current state
+    uint16_t h_cost;// heuristic cost to reach the goal
 
-    // initiate
-    Node(const std::string &pos_key, int g, int h, int p, Move move)
-        : pos_str(pos_key), g_cost(g), h_cost(h), f_cost(g+h), parent(p), mv(move){}
+    int f_cost() const { return g_cost + h_cost; }// g + h
 };
+static_assert(sizeof(Node) <= 16, "Node records should stay small");
 
-int heuristic(const Position& pos) {
-    int sum = 0;
-    Board red_board = pos.pieces(Red);// squares_sorted
-    Board black_board = pos.pieces(Black);
-    std::vector<int>used(SQUARE_NB, -1);
-    for(Square red_sq: BoardView(red_board)){
-        Piece target = pos.peek_piece_at(red_sq);
-        
-        int min_step = 1000;
-        int best_attack = -1;
-        for(Square black_sq: BoardView(black_board)){
-            Piece attacker = pos.peek_piece_at(black_sq);
-            if(attacker.type == Duck || !(attacker.type > target.type))
-                continue;
-
-            int cur_step = 1000;
-            if(attacker.type != Chariot)
-                cur_step = distance<Square>(black_sq, red_sq);
-            else{
-                // handle chariot
-                if(distance<Square>(black_sq, red_sq) == distance<Rank>(black_sq, red_sq)
-                || distance<Square>(black_sq, red_sq) == distance<File>(black_sq, red_sq))
-                    cur_step = 1;
-                else
-                    cur_step = 2;
-            }
+// memory a stored node takes: its record, its state, its open list slot, and two closed table entries
+// since the table is a power of two that only fills up to 7/8
+constexpr size_t NODE_BYTES = sizeof(Node) + sizeof(State) + 2 * sizeof(uint32_t) + 2 * sizeof(ClosedTable::Entry);
 
-            if(min_step > cur_step){
-                min_step = cur_step;
-                best_attack = black_sq;
-            }
+// depth-first search from pos (cost g, estimate h with its cache) without going over bound or depth more moves,
+// walked in place so plateaus never touch the open list or the closed table.
+// line holds the moves taken so far, a goal cheaper than best_cost is copied to best_line.
+// returns the smallest f seen past the bound or the depth, INT_MAX if there is none
+static int lookahead(Position &pos, int g, int h, const HeuristicCache &cache, int bound, int depth,
+                     std::vector<Move> &line, std::vector<Key> &trail, std::vector<Move> &best_line, int &best_cost)
+{
+    if(g + h > bound)
+        return g + h;
+    if(pos.is_hw1_goal()){
+        if(g < best_cost){
+            best_cost = g;
+            best_line = line;
         }
-        if(best_attack != -1){
-            if(used[best_attack] != -1){
-                if(used[best_attack] > min_step){// may be sequentially reached
-                    min_step = 0;
-                }
-                else if(used[best_attack] == min_step){
-                    min_step = 1;
-                }
-                else{// used[best_attack] < min_step
-                    int prev = used[best_attack];
-                    used[best_attack] = min_step;
-                    min_step -= prev;
-                }
-            }
-            else{
-                used[best_attack] = min_step;
-            }
+        return INT_MAX;
+    }
+    if(depth == 0)// a plateau can go on forever, stop here and let the open list take over
+        return g + h;
+    int next = INT_MAX;
+    MoveList<> moves(pos);
+    for(Move move: moves){
+        UndoInfo undo;
+        pos.do_move_unchecked(move, undo);
+        // don't walk in circles
+        if(std::find(trail.begin(), trail.end(), pos.key()) == trail.end()){
+            line.push_back(move);
+            trail.push_back(pos.key());
+            HeuristicCache child_cache;
+            int child_h = heuristic_after(pos, cache, move, child_cache);
+            next = std::min(next, lookahead(pos, g + 1, child_h, child_cache, bound, depth - 1, line, trail, best_line, best_cost));
+            trail.pop_back();
+            line.pop_back();
         }
-        sum += (min_step == 1000 ? 20 : min_step);
+        pos.undo_move(move, undo);
     }
-    return sum;
-}
-std::string position_key(Position& pos){
-    return pos.toFEN();
+    return next;
 }
 
-void resolve(Position &pos)
+bool astar(Position &pos, const SearchLimits &limits, std::vector<Move> &path, const AStarOptions &options)
 {
-    
-    auto start_time = std::chrono::high_resolution_clock::now();
-
-    if(pos.winner() == Black){ // already win
-        auto end_time = std::chrono::high_resolution_clock::now();
-        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-        info << std::fixed << std::setprecision(3) << duration.count() / 1000.0 << "\n";
-        info << "0\n";
-        return;
-    }
-    
-    std::unordered_map<std::string, int>visited;// key: pos_key, value: node index
-    std::vector<Node>nodes;
+    // open list key, g + weight * h scaled to stay an integer
+    auto priority = [&options](const Node &n) {
+        return options.weight_den * n.g_cost + options.weight_num * n.h_cost;
+    };
+    // which of the nodes with the same key goes first
+    auto tie_break = [&options](const Node &n) {
+        return options.high_h_first ? n.g_cost : n.h_cost;
+    };
+
+    // the closed table is sized from the memory limit and caps the nodes, the arenas grow up to it
+    ClosedTable visited(limits.memory_limit() / NODE_BYTES * 2 * sizeof(ClosedTable::Entry));// key: Zobrist key, value: node index and best g
+    NodeArena<Node>nodes;
+    NodeArena<State>states;
+    // a full table ends the search, dropping children could cost the optimal answer
+    auto out_of_memory = [&options, &nodes](){
+        DBG << "A*: out of memory after " << nodes.size() << " nodes\n";
+        if(options.out_of_memory)
+            *options.out_of_memory = true;
+        return false;
+    };
+    StateCodec codec(pos);
     Move m;
-    Node start_node(position_key(pos), 0, heuristic(pos), -1, m);
-    nodes.push_back(start_node);
-    // for pq, Compare(a, b) returns true if a has lower priority than b
-    auto cmp = [&nodes](int a, int b) {
-        const Node &na = nodes[a];
-        const Node &nb = nodes[b];
-        // primary: lower f-cost first
-        if (na.f_cost != nb.f_cost)
-            return na.f_cost > nb.f_cost;
-        // secondary: fewer pieces left on the board first
-        return na.h_cost > nb.h_cost;
-        // return na.g_cost < nb.g_cost;
+    Node start_node{NodeArena<Node>::NONE, m, 0, uint16_t(heuristic(pos))};
+    ClosedTable::Entry *root = visited.insert(pos.key());
+    if(root == nullptr || nodes.push(start_node) == NodeArena<Node>::NONE
+    || states.push(codec.encode(pos)) == NodeArena<State>::NONE){// couldn't get any memory at all
+        return out_of_memory();
+    }
+    root->index = 0;
+    root->g = 0;
+    // open list, ordered by lower (weighted) f-cost first, then fewer pieces left on the board first
+    BucketQueue<uint32_t> pq;
+    pq.push(0, priority(start_node), tie_break(start_node));// push the index of the first node
+
+    // moves from the root to node index
+    auto trace = [&nodes](uint32_t index, std::vector<Move> &moves){
+        moves.clear();
+        while(index != 0){
+            moves.push_back(nodes[index].mv);
+            index = nodes[index].parent;
+        }
+        std::reverse(moves.begin(), moves.end());
     };
-    std::priority_queue<int, std::vector<int>, decltype(cmp)> pq(cmp);
-    pq.push(0);// push the index of the first node
+    // lookahead: best goal seen so far, as a stored node plus the moves after it
+    int best_cost = INT_MAX;
+    uint32_t best_node = 0;
+    std::vector<Move> best_line, line;
+    std::vector<Key> trail;
 
     while(!pq.empty()){
         // check time exceed 10s or not
-        auto current_time = std::chrono::high_resolution_clock::now();
-        auto time_span = std::chrono::duration_cast<std::chrono::milliseconds>(current_time - start_time);
-        if(time_span.count() > 10000){
-            info << -1;
-            return;
-        }
+        if(limits.expired())
+            return false;
+        // nothing left in the open list can beat the goal lookahead found
+        if(best_cost != INT_MAX && pq.min_f() >= options.weight_den * best_cost)
+            break;
 
-        int cur_index = pq.top();
-        pq.pop();
+        int cur_key = pq.min_f();// the node's own priority, or a later one if partially expanded
+        uint32_t cur_index = pq.pop();
 
         Node cur = nodes[cur_index];
         Position cur_pos;
-        cur_pos.readFEN(cur.pos_str);
-        debug << "f_cost = " << cur.f_cost << ", g_cost = " << cur.g_cost << ", h_cost = " << cur.h_cost << "\n";
-        debug << cur_pos;
-
-        if(cur_pos.winner() == Black){
-            auto end_time = std::chrono::high_resolution_clock::now();
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
-            info << std::fixed << std::setprecision(3) << duration.count() / 1000.0 << "\n";
-            info << cur.f_cost << "\n";
-            std::vector<Move>moves;
-            while(cur_index != 0){
-                moves.push_back(nodes[cur_index].mv);
-                cur_index = nodes[cur_index].parent;
-            }
-            for(int i = moves.size() - 1; i >= 0; i--){
-                info << moves[i];
-            }
-            return;
-        }
+        codec.decode(states[cur_index], cur_pos);
+        if(visited.find(cur_pos.key())->index != cur_index)// stale, a cheaper path was found later
+            continue;
+        bool first_visit = cur_key == priority(cur);
+        DBG << "f_cost = " << cur.f_cost() << ", g_cost = " << cur.g_cost << ", h_cost = " << cur.h_cost << "\n";
+        DBG << cur_pos;
 
+        if(first_visit && cur_pos.is_hw1_goal() && cur.g_cost < best_cost){
+            trace(cur_index, path);
+            return true;
+        }
+        // children's h comes from the parent's, see heuristic_after()
+        HeuristicCache cur_cache, new_cache;
+        heuristic(cur_pos, cur_cache);
+        // partial expansion: the priority this node comes back with, and its tie-break
+        int next_key = INT_MAX;
+        int next_tie = 0;
         MoveList<> moves(cur_pos);
         for(Move move: moves){
-            Position new_pos(cur_pos);
-            if(new_pos.do_move(move)){
-                std::string new_pos_key = position_key(new_pos);
-                int new_g = cur.g_cost + 1;
-                int new_h = heuristic(new_pos);
-                if(visited.find(new_pos_key) == visited.end() || nodes[visited[new_pos_key]].g_cost > new_g){
-                    Node new_node(new_pos_key, new_g, new_h, cur_index, move);
-                    nodes.push_back(new_node);
-                    int new_index = nodes.size() - 1;
-                    visited[new_pos_key] = new_index;
-                    pq.push(new_index);
+            // walk the children in place, the move is legal so it needs no checks
+            UndoInfo undo;
+            cur_pos.do_move_unchecked(move, undo);
+            int new_g = cur.g_cost + 1;
+            Node new_node{cur_index, move, uint16_t(new_g), 0};
+            if(options.partial_expansion){
+                new_node.h_cost = heuristic_after(cur_pos, cur_cache, move, new_cache);
+                // children with a later priority wait until the node comes back with it,
+                // those with an earlier one were stored the first time
+                int key = priority(new_node);
+                if(key > cur_key){
+                    if(key < next_key || (key == next_key && tie_break(new_node) < next_tie)){
+                        next_key = key;
+                        next_tie = tie_break(new_node);
+                    }
+                    cur_pos.undo_move(move, undo);
+                    continue;
+                }
+                if(key < cur_key && !first_visit){
+                    cur_pos.undo_move(move, undo);
+                    continue;
+                }
+            }
+            ClosedTable::Entry *seen = visited.insert(cur_pos.key());
+            if(seen == nullptr)
+                return out_of_memory();
+            if(seen->g > new_g){
+                if(!options.partial_expansion)
+                    new_node.h_cost = heuristic_after(cur_pos, cur_cache, move, new_cache);
+                if(new_node.f_cost() >= std::min(options.cost_bound, best_cost)){// can't beat the solution we have
+                    cur_pos.undo_move(move, undo);
+                    continue;
                 }
+                if(options.lookahead_depth > 0){
+                    // the child goes in with the f found just past the lookahead bound
+                    int old_best = best_cost;
+                    line.assign(1, move);
+                    trail.assign(1, cur_pos.key());
+                    int f = lookahead(cur_pos, new_g, new_node.h_cost, new_cache, cur.f_cost() + options.lookahead_margin,
+                                      options.lookahead_depth, line, trail, best_line, best_cost);
+                    if(best_cost < old_best)// best_line starts with this move
+                        best_node = cur_index;
+                    if(f == INT_MAX || f >= best_cost){// nothing better below it
+                        cur_pos.undo_move(move, undo);
+                        continue;
+                    }
+                    new_node.h_cost = uint16_t(f - new_g);
+                }
+                uint32_t new_index = nodes.push(new_node);
+                if(new_index != NodeArena<Node>::NONE && states.push(codec.encode(cur_pos)) == NodeArena<State>::NONE){
+                    nodes.pop_back();
+                    new_index = NodeArena<Node>::NONE;
+                }
+                if(new_index == NodeArena<Node>::NONE)
+                    return out_of_memory();
+                seen->index = new_index;
+                seen->g = new_g;
+                pq.push(new_index, priority(new_node), tie_break(new_node));
             }
+            cur_pos.undo_move(move, undo);
         }
+        if(next_key != INT_MAX)
+            pq.push(cur_index, next_key, next_tie);
     }
-    info << -1;
-    // if reach here, no solution was found. shouldn't happen though
-}
\ No newline at end of file
+    if(best_cost == INT_MAX)
+        return false;// no solution, shouldn't happen though
+    trace(best_node, path);
+    path.insert(path.end(), best_line.begin(), best_line.end());
+    return true;
+}
+
+void resolve(Position &pos)
+{
+    auto start_time = Clock::now();
+    SearchLimits limits{start_time + std::chrono::milliseconds(TIME_LIMIT_MS)};
+
+    heuristic_init(pos);// the ducks are known now
+
+    std::vector<Move> path;
+    bool solved = pos.is_hw1_goal();// already win
+    if(!solved){
+        switch(SOLVER){
+            case AStar:
+                solved = astar(pos, limits, path);
+                break;
+            case IDAStar:
+                solved = idastar(pos, limits, path);
+                break;
+            case Anytime:
+                solved = anytime(pos, limits, path);
+                break;
+            case Frontier:
+                solved = frontier(pos, limits, path);
+                break;
+            case External:
+                solved = external(pos, limits, path);
+                break;
+            case SMAStar:
+                solved = smastar(pos, limits, path);
+                break;
+            case PEAStar:{
+                AStarOptions options;
+                options.partial_expansion = true;
+                solved = astar(pos, limits, path, options);
+                break;
+            }
+            case Lookahead:{
+                AStarOptions options;
+                options.lookahead_margin = LOOKAHEAD_MARGIN;
+                options.lookahead_depth = LOOKAHEAD_DEPTH;
+                solved = astar(pos, limits, path, options);
+                break;
+            }
+            case HDAStar:
+                solved = hdastar(pos, limits, path);
+                break;
+            case Portfolio:
+                solved = portfolio(pos, limits, path);
+                break;
+            case Exhaustive:
+                //too many states for the bitsets: fall back to A*
+                solved = exhaustive(pos, limits, path) || astar(pos, limits, path);
+                break;
+        }
+    }
+    if(!solved){
+        info << -1;
+        return;
+    }
+
+    auto end_time = Clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time);
+    info << std::fixed << std::setprecision(3) << duration.count() / 1000.0 << "\n";
+    info << path.size() << "\n";
+    for(Move move: path){
+        info << move;
+    }
+}
@@ -5,5 +5,17 @@
 # +-- Set to 0 for English board output --+
 CHINESE = 1
 
+# +-- Solving mode, see search.h --+
+SOLVER = AStar
+
+# +-- Heuristic, see heuristic.h --+
+HEURISTIC = Tour
+
 # +-- Add your own sources here, if any --+
-ADD_SOURCES = solver.cpp
\ No newline at end of file
+ADD_SOURCES = solver.cpp state.cpp heuristic.cpp ida.cpp anytime.cpp frontier.cpp extmem.cpp sma.cpp hda.cpp memory.cpp portfolio.cpp rank.cpp bfs.cpp assignment.cpp tour.cpp pattern.cpp
+
+# +-- The makefile hands ADD_SOURCES to g++ as is, so the settings above ride along --+
+ADD_SOURCES += -DSOLVER=$(SOLVER) -DHEURISTIC=$(HEURISTIC)
+
+# +-- `make dbg` traces the search too, see LOG_LEVEL in lib/cdc.h --+
+dbg: ADD_SOURCES += -DLOG_LEVEL=LOG_DEBUG
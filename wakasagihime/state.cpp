@@ -0,0 +1,81 @@
+// Chinese Dark Chess: puzzle states
+// ----------------------------------
+
+#include "state.h"
+
+using Packed = unsigned __int128;
+
+static inline Packed unpack(const State &s) { return (Packed(s.hi) << 64) | s.lo; }
+
+static inline State pack(Packed p) { return State{ uint64_t(p), uint64_t(p >> 64) }; }
+
+StateCodec::StateCodec(const Position &root)
+  : base(root)
+  , redCount(0)
+  , blackCount(0)
+{
+    for (Square sq : BoardView(root.pieces(Red) & ~root.pieces(Duck))) {
+        assert(redCount < MAX_SLOTS);
+        redSquare[redCount] = sq;
+        redPiece[redCount]  = root.peek_piece_at(sq);
+        redCount += 1;
+        base.remove_piece_at(sq);
+    }
+    for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+        for (Square sq : BoardView(root.pieces(Black, pt))) {
+            assert(blackCount < MAX_SLOTS);
+            blackType[blackCount] = pt;
+            blackCount += 1;
+            base.remove_piece_at(sq);
+        }
+    }
+}
+
+State StateCodec::encode(const Position &pos) const
+{
+    Packed p = 0;
+    for (int i = 0; i < redCount; i += 1) {
+        if (pos.pieces(Red) & redSquare[i]) {
+            p |= Packed(1) << i;
+        }
+    }
+
+    // Pieces of the same type are interchangeable, so each type is written
+    // in ascending square order. That keeps the encoding canonical.
+    int shift = redCount;
+    for (PieceType pt = General; pt < MOVABLE_PIECE_TYPE_NB; pt += 1) {
+        for (Square sq : BoardView(pos.pieces(Black, pt))) {
+            p |= Packed(sq) << shift;
+            shift += 5;
+        }
+    }
+    assert(shift == redCount + 5 * blackCount);
+    return pack(p);
+}
+
+void StateCodec::decode(const State &s, Position &pos) const
+{
+    pos = base;
+    for (int i = 0; i < redCount; i += 1) {
+        if (red_alive(s, i)) {
+            pos.place_piece_at(redPiece[i], redSquare[i]);
+        }
+    }
+    for (int i = 0; i < blackCount; i += 1) {
+        pos.place_piece_at(Piece(Black, blackType[i]), black_square(s, i));
+    }
+}
+
+State StateCodec::compose(uint32_t redAlive, const Square *blackSquares) const
+{
+    Packed p = redAlive;
+    for (int i = 0; i < blackCount; i += 1) {
+        p |= Packed(blackSquares[i]) << (redCount + 5 * i);
+    }
+    return pack(p);
+}
+
+Square StateCodec::black_square(const State &s, int i) const
+{
+    return Square((unpack(s) >> (redCount + 5 * i)) & 0x1F);
+}
@@ -0,0 +1,109 @@
+// Chinese Dark Chess: puzzle states
+// ----------------------------------
+// In HW1 only black moves: red pieces never move and ducks never do either.
+// A search state is therefore "which black piece is on which square"
+// plus "which red pieces are still alive", relative to the initial puzzle.
+
+#ifndef STATE_H
+#define STATE_H
+
+#include "lib/chess.h"
+#include "lib/types.h"
+
+#include <cstdint>
+#include <functional>
+
+// At most 16 pieces a side, 5 bits per black square plus 1 bit per red piece
+constexpr int MAX_SLOTS = 16;
+
+/*
+ * A packed puzzle state. Only meaningful together with the StateCodec that made it.
+ * Bits 0 ~ (red count - 1): red piece i is alive
+ * Then 5 bits per black piece: its square
+ */
+struct State {
+    uint64_t lo, hi;
+
+    bool operator==(const State &other) const { return lo == other.lo && hi == other.hi; }
+    bool operator!=(const State &other) const { return !(*this == other); }
+    bool operator<(const State &other) const
+    {
+        return hi != other.hi ? hi < other.hi : lo < other.lo;
+    }
+};
+
+class StateCodec {
+    private:
+    // The puzzle with every piece that can move or be captured taken away
+    Position base;
+    // Red pieces, by initial square
+    Square redSquare[MAX_SLOTS];
+    Piece redPiece[MAX_SLOTS];
+    int redCount;
+    // Black pieces, grouped by type, in the order encode() visits them
+    PieceType blackType[MAX_SLOTS];
+    int blackCount;
+
+    public:
+    /*
+     * Builds a codec for a puzzle.
+     * @param   root    The initial puzzle. Every state must descend from it.
+     */
+    explicit StateCodec(const Position &root);
+
+    /*
+     * Packs a position.
+     * @param   pos A position reachable from the root
+     * @returns The packed state
+     */
+    State encode(const Position &pos) const;
+
+    /*
+     * Unpacks a state.
+     * @param   s   A state from encode()
+     * @param   pos Overwritten with the unpacked position
+     */
+    void decode(const State &s, Position &pos) const;
+
+    /*
+     * Packs a state from its parts, the inverse of red_alive() and black_square().
+     * @param   redAlive        Bit i set if red slot i is alive
+     * @param   blackSquares    One square per black slot, ascending within each type
+     * @returns The packed state
+     */
+    State compose(uint32_t redAlive, const Square *blackSquares) const;
+
+    /*
+     * Number of red and black pieces that take part in the search.
+     */
+    int red_count() const { return redCount; }
+    int black_count() const { return blackCount; }
+
+    /*
+     * Reads a packed state without unpacking it.
+     * @param   s   The state
+     * @param   i   Red or black slot index
+     */
+    static bool red_alive(const State &s, int i) { return (s.lo >> i) & 1; }
+    Square black_square(const State &s, int i) const;
+    PieceType black_type(int i) const { return blackType[i]; }
+    Square red_square(int i) const { return redSquare[i]; }
+    Piece red_piece(int i) const { return redPiece[i]; }
+};
+
+namespace std {
+template<>
+struct hash<State> {
+    size_t operator()(const State &s) const noexcept
+    {
+        // Murmur-style finaliser over both words
+        uint64_t h = s.lo ^ (s.hi * 0x9E3779B97F4A7C15ULL);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+} // namespace std
+
+#endif
@@ -0,0 +1,126 @@
+// Chinese Dark Chess: capture tours
+// ----------------------------------
+// A lower bound for puzzles where one black piece has to eat its way round
+// the board. A red piece that only one black piece can ever capture has to
+// be captured by that piece, so each such piece makes at least the shortest
+// tour through its own red pieces. The pieces move in turns, so their tours
+// add up.
+//
+// Tours are Held-Karp over the red pieces, with the duck-aware capture
+// distances as legs. They only depend on the piece, its square and which of
+// its red pieces are left, and are remembered by that in a shared table.
+
+#include "heuristic.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace {
+
+// Red pieces in one tour. Any subset of them gives a lower bound, so the
+// rest are left out rather than letting the table grow.
+constexpr int MAX_TOUR = 10;
+// Remembered tours, one packed word each
+constexpr int MEMO_BITS = 13;
+constexpr int MEMO_SIZE = 1 << MEMO_BITS;
+constexpr int NO_TOUR   = NO_LEG;
+
+// Bits 0 ~ 15: tour length + 1 (0 for an empty slot)
+// Bits 16 ~ 47: red pieces left, as a board
+// Bits 48 ~ 52: square, bits 53 ~ 55: piece type
+std::atomic<uint64_t> memo[MEMO_SIZE];
+
+uint64_t memo_key(PieceType pt, Square sq, Board targets)
+{
+    return (uint64_t(pt) << 53) | (uint64_t(sq) << 48) | (uint64_t(targets) << 16);
+}
+
+/*
+ * Shortest walk of a piece capturing every red piece on _targets_, in any order.
+ */
+int held_karp(PieceType pt, Square start, Board targets)
+{
+    Square red[MAX_TOUR];
+    int n = 0;
+    for (Square sq : BoardView(targets)) {
+        if (n == MAX_TOUR) {
+            break;
+        }
+        red[n++] = sq;
+    }
+
+    // cost[mask][last]: capture the pieces in mask, finishing on red[last]
+    uint16_t cost[1 << MAX_TOUR][MAX_TOUR];
+    int full = (1 << n) - 1;
+    for (int mask = 1; mask <= full; mask += 1) {
+        for (int last = 0; last < n; last += 1) {
+            if (!(mask >> last & 1)) {
+                continue;
+            }
+            int rest = mask ^ (1 << last);
+            int best = NO_TOUR;
+            if (rest == 0) {
+                best = capture_leg(pt, start, red[last]);
+            }
+            for (int prev = 0; prev < n; prev += 1) {
+                if (rest >> prev & 1) {
+                    best = std::min(best, cost[rest][prev] + capture_leg(pt, red[prev], red[last]));
+                }
+            }
+            cost[mask][last] = uint16_t(std::min(best, NO_TOUR));
+        }
+    }
+    int best = NO_TOUR;
+    for (int last = 0; last < n; last += 1) {
+        best = std::min<int>(best, cost[full][last]);
+    }
+    return best;
+}
+
+int tour(PieceType pt, Square start, Board targets)
+{
+    uint64_t key              = memo_key(pt, start, targets);
+    std::atomic<uint64_t> &at = memo[(key >> 16) * 0x9E3779B97F4A7C15ULL >> (64 - MEMO_BITS)];
+    uint64_t seen             = at.load(std::memory_order_relaxed);
+    if ((seen & ~uint64_t(0xFFFF)) == key && (seen & 0xFFFF)) {
+        return int(seen & 0xFFFF) - 1;
+    }
+    int length = held_karp(pt, start, targets);
+    at.store(key | uint64_t(length + 1), std::memory_order_relaxed);
+    return length;
+}
+
+} // namespace
+
+void tour_reset()
+{
+    for (std::atomic<uint64_t> &at : memo) {
+        at.store(0, std::memory_order_relaxed);
+    }
+}
+
+int tour_heuristic(const HeuristicCache &cache)
+{
+    Board sole[SIDE_PIECE_NB] = {}; // by the only piece that can capture them
+    for (int r = 0; r < cache.reds; r += 1) {
+        int attackers = 0;
+        int attacker  = 0;
+        for (int b = 0; b < cache.blacks; b += 1) {
+            if (cache.leg[r][b] != NO_LEG) {
+                attacker = b;
+                attackers += 1;
+            }
+        }
+        if (attackers == 1) {
+            sole[attacker] |= cache.red[r];
+        }
+    }
+
+    int sum = 0;
+    for (int b = 0; b < cache.blacks; b += 1) {
+        if (sole[b]) {
+            sum += tour(cache.blackType[b], cache.black[b], sole[b]);
+        }
+    }
+    return std::min(sum, NO_TOUR);
+}
@@ -31,6 +31,9 @@ __attribute__((constructor)) void prepare()
     // Prepare magic
     init_magic<Chariot>(chariotTable, chariotMagics);
     init_magic<Cannon>(cannonTable, cannonMagics);
+
+    // Prepare Zobrist keys
+    Zobrist::init();
 }
 
 // le fishe